@@ -1,335 +1,1822 @@
 #include "nest.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
-// Trace
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-// Open
-// Message
-// Close
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-// General
+static void geometryFlush(void);
+static void geometryFree(void);
+static void layersInvalidate(bool deviceLost);
+static void layersFree(void);
+static void tilemapsInvalidate(bool deviceLost);
+static void tilemapsFree(void);
+static void commandsBeginFrame(bool record);
+static void commandsEndFrame(bool submitted);
+static void commandsRenderSubmitted(void);
+static void commandsPresentDirty(SDL_Window* window);
+static void renderRelease(void (*release)(void*), void* data);
+static void renderThreadCall(void (*task)(void*), void* data);
+static void commandsInvalidate(void);
+static void commandsFree(void);
+static void spriteBatchFlush(void);
+static void spritesFree(void);
+static void textureInfoFree(void);
+static void textBatchFlush(void);
+static void textsFree(void);
+static void jobsFree(void);
+static void rasterClear(color c);
+static void rasterPresent(void);
+static void rasterFree(void);
+static void packsFree(void);
+static void postBegin(void);
+static void postEnd(void);
+static void postProcess(Uint32* pixels, int width, int height);
+static void postsInvalidate(bool deviceLost);
+static void postsFree(void);
+static void animationsUpdate(float dt);
+static void animationsFree(void);
+static void tweensUpdate(float dt);
+static void tweensFree(void);
+static void inputApplyFilter(void);
+static void inputBeginFrame(void);
+static void inputHandleEvent(SDL_Event* e);
+static void inputEndFrame(void);
+static void inputLatch(void);
+static void inputFree(void);
+static void audioFree(void);
+static void tracesFree(void);
 
-float deltaTime(void) {
-    static Uint32 lastTime = 0;
-    Uint32 currentTime = SDL_GetTicks();
-    float t = (currentTime - lastTime) / 1000.0f;
-    lastTime = currentTime;
-    return t;
-}
+// Trace
 
-float lerpf(float a, float b, float t) {
-    return a + t * (b - a);
-}
+#define TRACE_RING 4096
+#define TRACE_MAX_THREADS 64
+#define TRACE_TEXT 40
 
-int lerpi(int a, int b, float t) {
-    return (int)(a + t * (b - a) + 0.5f);
-}
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
 
-color rgb(int r, int g, int b) {
-    color c;
+typedef struct traceRecord {
+    Uint64 time;
+    const char* name;
+    char phase;
+    union {
+        double value;
+        char text[TRACE_TEXT];
+    };
+} traceRecord;
 
-    c.r = (Uint8)r;
-    c.g = (Uint8)g;
-    c.b = (Uint8)b;
+typedef struct traceRing {
+    traceRecord records[TRACE_RING];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t dropped;
+    SDL_threadID thread;
+} traceRing;
 
-    return c;
-}
+static traceRing* traceRings[TRACE_MAX_THREADS];
+static SDL_atomic_t traceRingCount;
+static SDL_SpinLock traceAttachLock;
+static TRACE_THREAD_LOCAL traceRing* traceLocal;
+static TRACE_THREAD_LOCAL int traceLocalEpoch;
+static SDL_atomic_t traceEpoch;
+static SDL_atomic_t traceActive;
+static SDL_atomic_t traceQuit;
+static FILE* traceFile;
+static SDL_Thread* traceThread;
+static SDL_sem* traceWake;
+static Uint64 traceStart;
+static bool traceFirst;
 
-color hex(char* h) {
-    color c;
+static traceRing* traceAttach(void) {
+    traceRing* r = memoryCalloc(MEMORY_GENERAL, 1, sizeof(traceRing));
 
-    if (h[0] == '#') {
-        h++;
+    if (!r) {
+        return NULL;
     }
 
-    if (sscanf(h, "%2hhx%2hhx%2hhx", &c.r, &c.g, &c.b) != 3) {
-        c.r = c.g = c.b = 0;
+    r->thread = SDL_ThreadID();
+    SDL_AtomicLock(&traceAttachLock);
+
+    int count = SDL_AtomicGet(&traceRingCount);
+
+    if (count == TRACE_MAX_THREADS) {
+        SDL_AtomicUnlock(&traceAttachLock);
+        memoryFree(r);
+        return NULL;
     }
 
-    return c;
+    traceRings[count] = r;
+    SDL_AtomicSet(&traceRingCount, count + 1);
+    SDL_AtomicUnlock(&traceAttachLock);
+
+    traceLocal = r;
+    traceLocalEpoch = SDL_AtomicGet(&traceEpoch);
+
+    return r;
 }
 
-// States
-static state current;
+static traceRecord* traceReserve(traceRing** ring) {
+    traceRing* r = traceLocal && traceLocalEpoch == SDL_AtomicGet(&traceEpoch) ? traceLocal : traceAttach();
 
-void setCurrentState(stateFunction init, stateFunction update, stateFunction exit) {
-    if (current.exit) {
-        current.exit(NULL);
+    if (!r) {
+        return NULL;
     }
 
-    current.init = init ? init : NULL;
-    current.update = update ? update : NULL;
-    current.exit = exit ? exit : NULL;
+    Uint32 head = (Uint32)SDL_AtomicGet(&r->head);
 
-    if (current.init) {
-        current.init(NULL);
+    if (head - (Uint32)SDL_AtomicGet(&r->tail) == TRACE_RING) {
+        SDL_AtomicIncRef(&r->dropped);
+        return NULL;
     }
+
+    *ring = r;
+
+    return &r->records[head & (TRACE_RING - 1)];
 }
 
-state* getCurrentState(void) {
-    return &current;
+static void traceCommit(traceRing* r) {
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&r->head, SDL_AtomicGet(&r->head) + 1);
 }
 
-// Loop
+static void traceWrite(char phase, const char* name, double value) {
+    traceRing* r;
+    traceRecord* record;
 
-static color backgroundColor;
-int imgFlags;
+    if (!SDL_AtomicGet(&traceActive) || !(record = traceReserve(&r))) {
+        return;
+    }
 
-void setBackgroundColor(color c) {
-    backgroundColor = c;
+    record->time = SDL_GetPerformanceCounter();
+    record->name = name;
+    record->phase = phase;
+    record->value = value;
+    traceCommit(r);
 }
 
-static nest* initializedNest;
-
-int initNest(nest* n, const char* title, int width, int height) {
-    if (!n) {
-        return -1;
+static void traceString(const char* text) {
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', traceFile);
+            fputc(*text, traceFile);
+        }
+        else if ((unsigned char)*text >= 0x20) {
+            fputc(*text, traceFile);
+        }
     }
+}
 
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        return -1;
-    }
+// Converts whatever the threads have committed into Chrome trace events. Only
+// the flusher, or traceClose once it has stopped, consumes the rings.
+static void traceFlush(void) {
+    double scale = 1000000.0 / SDL_GetPerformanceFrequency();
+    int count = SDL_AtomicGet(&traceRingCount);
 
-    else {
-        n->window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, 0);
+    for (int i = 0; i < count; i++) {
+        traceRing* r = traceRings[i];
+        Uint32 tail = (Uint32)SDL_AtomicGet(&r->tail);
+        Uint32 head = (Uint32)SDL_AtomicGet(&r->head);
 
-        if (!n->window) {
-            return -1;
-        }
+        SDL_MemoryBarrierAcquire();
 
-        n->renderer = SDL_CreateRenderer(n->window, -1, SDL_RENDERER_ACCELERATED);
+        for (; tail != head; tail++) {
+            const traceRecord* record = &r->records[tail & (TRACE_RING - 1)];
 
-        if (!n->renderer) {
-            return -1;
-        }
+            if (record->time < traceStart) {
+                continue;
+            }
 
-        imgFlags = IMG_INIT_PNG;
-        
-        if (!(IMG_Init(imgFlags) && imgFlags)) {
-            return -1;
+            fprintf(traceFile, "%s\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"name\":\"",
+                    traceFirst ? "" : ",", record->phase, (unsigned long)r->thread, (record->time - traceStart) * scale);
+            traceString(record->name ? record->name : "message");
+            traceFirst = FALSE;
+
+            if (record->phase == 'C') {
+                fprintf(traceFile, "\",\"args\":{\"value\":%g}}", record->value);
+            }
+            else if (record->phase == 'i' && !record->name) {
+                fputs("\",\"s\":\"t\",\"args\":{\"text\":\"", traceFile);
+                traceString(record->text);
+                fputs("\"}}", traceFile);
+            }
+            else if (record->phase == 'i') {
+                fputs("\",\"s\":\"t\"}", traceFile);
+            }
+            else {
+                fputs("\"}", traceFile);
+            }
         }
+
+        SDL_AtomicSet(&r->tail, (int)tail);
     }
+}
 
-    backgroundColor = rgb(0, 0, 0);
+static int SDLCALL traceFlusher(void* data) {
+    (void)data;
 
-    initializedNest = n;
+    while (!SDL_AtomicGet(&traceQuit)) {
+        SDL_SemWaitTimeout(traceWake, 10);
+        traceFlush();
+    }
 
     return 0;
 }
 
-void runNest(void) {
-    if (initializedNest) {
+// Open
 
-        bool running = TRUE;
+bool traceOpen(const char* path) {
+    traceClose();
+    traceFile = fopen(path, "w");
+    traceWake = traceFile ? SDL_CreateSemaphore(0) : NULL;
 
-        while(running)
-        {
-            SDL_RenderClear(initializedNest->renderer);
+    if (!traceWake) {
+        if (traceFile) {
+            fclose(traceFile);
+            traceFile = NULL;
+        }
 
-            if (current.update) {
-                current.update(NULL);
-            }
+        return FALSE;
+    }
 
-            SDL_Event e;
-            while(SDL_PollEvent(&e) > 0)
-            {
-                if (e.type == SDL_QUIT) {
-                    running = FALSE;
-                }
-            }
+    setvbuf(traceFile, NULL, _IOFBF, 1 << 16);
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", traceFile);
 
-            SDL_SetRenderDrawColor(initializedNest->renderer, backgroundColor.r, backgroundColor.g, backgroundColor.b, 255);
-            SDL_RenderPresent(initializedNest->renderer);
-        }
+    for (int i = 0; i < SDL_AtomicGet(&traceRingCount); i++) {
+        SDL_AtomicSet(&traceRings[i]->tail, SDL_AtomicGet(&traceRings[i]->head));
+        SDL_AtomicSet(&traceRings[i]->dropped, 0);
     }
-}
 
-void cleanNest(void) {
-    if (initializedNest) {
-        if (current.exit) {
-            current.exit(NULL);
-        }
+    traceStart = SDL_GetPerformanceCounter();
+    traceFirst = TRUE;
+    SDL_AtomicSet(&traceQuit, 0);
+    SDL_AtomicSet(&traceActive, 1);
+    traceThread = SDL_CreateThread(traceFlusher, "nest trace", NULL);
 
-        SDL_DestroyRenderer(initializedNest->renderer);
-        SDL_DestroyWindow(initializedNest->window);
-        IMG_Quit();
-        SDL_Quit();
-    }
+    return TRUE;
 }
 
-// Vector
+// Message
 
-vector2 vectorZero(void) {
-    return (vector2){ 0, 0 };
+void traceBegin(const char* name) {
+    traceWrite('B', name, 0);
 }
 
-vector2 vectorUp(void) {
-    return (vector2){ 0, 1 };
+void traceEnd(const char* name) {
+    traceWrite('E', name, 0);
 }
 
-vector2 vectorRight(void) {
-    return (vector2){ 1, 0 };
+void traceInstant(const char* name) {
+    traceWrite('i', name, 0);
 }
 
-void vectorSet(vector2* a, float x, float y) {
-    if (a) {
-        a->x = x;
-        a->y = y;
-    }
+void traceCounter(const char* name, double value) {
+    traceWrite('C', name, value);
 }
 
-void vectorNeg(vector2* a) {
-    if (a) {
-        a->x = -a->x;
-        a->y = -a->y;
+void traceMessage(const char* format, ...) {
+    traceRing* r;
+    traceRecord* record;
+    va_list args;
+
+    if (!SDL_AtomicGet(&traceActive) || !(record = traceReserve(&r))) {
+        return;
     }
+
+    record->time = SDL_GetPerformanceCounter();
+    record->name = NULL;
+    record->phase = 'i';
+    va_start(args, format);
+    SDL_vsnprintf(record->text, TRACE_TEXT, format, args);
+    va_end(args);
+    traceCommit(r);
 }
 
-void vectorAdd(vector2* a, vector2* b1, vector2* b2) {
-    if (a && b1 && b2) {
-        a->x = b1->x + b2->x;
-        a->y = b1->y + b2->y;
+// Close
+
+void traceClose(void) {
+    int dropped = 0;
+
+    if (!traceFile) {
+        return;
     }
-}
 
-void vectorSub(vector2* a, vector2* b1, vector2* b2) {
-    if (a && b1 && b2) {
-        a->x = b1->x - b2->x;
-        a->y = b1->y - b2->y;
+    SDL_AtomicSet(&traceActive, 0);
+    SDL_AtomicSet(&traceQuit, 1);
+    SDL_SemPost(traceWake);
+
+    if (traceThread) {
+        SDL_WaitThread(traceThread, NULL);
+        traceThread = NULL;
     }
-}
 
-void vectorNormalize(vector2* a) {
-    if (a) {
-        float length = sqrtf(powf(a->x, 2) + powf(a->x, 2));
+    traceFlush();
+    fputs("\n]}\n", traceFile);
+    fclose(traceFile);
+    SDL_DestroySemaphore(traceWake);
+    traceFile = NULL;
+    traceWake = NULL;
 
-        if (length <= 0) {
-            vectorZero();
-        }
-        else {
-            a->x = (a->x / length);
-            a->y = (a->y / length);
-        }
+    for (int i = 0; i < SDL_AtomicGet(&traceRingCount); i++) {
+        dropped += SDL_AtomicGet(&traceRings[i]->dropped);
     }
-}
 
-void vectorScale(vector2* a, float scale) {
-    if (a) {
-        a->x = a->x * scale;
-        a->y = a->y * scale;
+    if (dropped > 0) {
+        SDL_Log("trace: %d records dropped", dropped);
     }
 }
 
-float vectorLength(vector2* a) {
-    if (a) {
-        return sqrtf(powf(a->x, 2) + powf(a->x, 2));
+// Rings outlive trace sessions; bumping the epoch makes every thread attach anew.
+static void tracesFree(void) {
+    traceClose();
+    SDL_AtomicLock(&traceAttachLock);
+
+    for (int i = 0; i < SDL_AtomicGet(&traceRingCount); i++) {
+        memoryFree(traceRings[i]);
+        traceRings[i] = NULL;
     }
 
-    return 0.0f;
+    SDL_AtomicSet(&traceRingCount, 0);
+    SDL_AtomicIncRef(&traceEpoch);
+    SDL_AtomicUnlock(&traceAttachLock);
+    traceLocal = NULL;
 }
 
-float vectorDistance(vector2* a, vector2* b) {
-    if (a && b) {
-        float dx = b->x - a->x;
-        float dy = b->y - a->y;
+// General
 
-        return sqrtf(powf(dx, 2) + powf(dy, 2));
-    }
+static float frameDelta;
 
-    return 0.0f;
+float deltaTime(void) {
+    return frameDelta;
 }
 
-float vectorDotProd(vector2* a, vector2* b) {
-    if (a && b) {
-        return (a->x * b->x) + (a->y * b->y);
-    }
+float lerpf(float a, float b, float t) {
+    return a + t * (b - a);
+}
 
-    return 0.0f;
+int lerpi(int a, int b, float t) {
+    return (int)(a + t * (b - a) + 0.5f);
 }
 
-void vectorLerp(vector2* result, vector2* a, vector2* b, float t) {
-    if (result && a && b) {
-        result->x = lerpf(a->x, b->x, t);
-        result->y = lerpf(a->y, b->y, t);
-    }
+SDL_COMPILE_TIME_ASSERT(colorLayout, sizeof(color) == sizeof(SDL_Color));
+
+color rgb(int r, int g, int b) {
+    return rgba(r, g, b, 255);
 }
 
-// Angles
+color rgba(int r, int g, int b, int a) {
+    color c;
 
-float angleDegtoRad(angle deg) {
-    if (deg) {
-        return *deg * (M_PI/180);
-    }
+    c.r = (Uint8)r;
+    c.g = (Uint8)g;
+    c.b = (Uint8)b;
+    c.a = (Uint8)a;
 
-    return 0.0f;
+    return c;
 }
 
-float angleRadtoDeg(angle rad) {
-    if (rad) {
-        return *rad * (180/M_PI);
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
     }
 
-    return 0.0f;
-}
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
 
-float angleShortestDistance(angle a, angle b) {
-    float diff = fmodf(*b - *a + 180.0f, 360.0f) - 180.0f;
-    return diff < -180.0f ? diff + 360.0f : diff;
-}
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
 
-float angleShortestDistanceRad(angle a, angle b) {
-    float diff = fmodf(*b - *a + M_PI, 2 * M_PI) - M_PI;
-    return diff < -M_PI ? diff + 2 * M_PI : diff;
+    return -1;
 }
 
-float angleNormalizeDeg(angle deg) {
-    return fmodf(*deg + 360.0f, 360.0f);
-}
+color hex(const char* h) {
+    Uint32 value = 0;
+    int digits = 0;
 
-float angleNormalizeRad(angle rad) {
-    return fmodf(*rad + 2 * M_PI, 2 * M_PI);
-}
+    if (!h) {
+        return rgb(0, 0, 0);
+    }
 
-float angleNormalizeDegSigned(angle deg) {
-    float normalized = fmodf(*deg + 180.0f, 360.0f) - 180.0f;
-    return normalized < -180.0f ? normalized + 360.0f : normalized;
-}
+    if (h[0] == '#') {
+        h++;
+    }
 
-float angleNormalizeRadSigned(angle rad) {
-    float normalized = fmodf(*rad + M_PI, 2 * M_PI) - M_PI;
-    return normalized < -M_PI ? normalized + 2 * M_PI : normalized;
-}
+    for (; h[digits]; digits++) {
+        int digit = hexDigit(h[digits]);
 
-void angleToVector(vector2* v, angle deg) {
-    if (v) {
-        float rad = *deg * (M_PI / 180.0f);
-        v->x = cosf(rad);
-        v->y = sinf(rad);
+        if (digit < 0 || digits == 8) {
+            return rgb(0, 0, 0);
+        }
+
+        value = (value << 4) | (Uint32)digit;
     }
-}
 
-void angleToVectorRad(vector2* v, angle rad) {
-    if (v) {
-        v->x = cosf(*rad);
-        v->y = sinf(*rad);
+    if (digits == 6) {
+        return COLOR_HEX(value);
     }
-}
 
-float angleLerp(angle a, angle b, float t) {
-    float shortest = angleShortestDistance(a, b);
-    return *a + t * shortest;
+    return digits == 8 ? COLOR_HEXA(value) : rgb(0, 0, 0);
 }
 
-float angleLerpRad(angle a, angle b, float t) {
-    float shortest = angleShortestDistanceRad(a, b);
-    return *a + t * shortest;
-}
+static SDL_Color colorSDL(color c) {
+    SDL_Color result;
 
-// Entities
+    memcpy(&result, &c, sizeof(result));
+
+    return result;
+}
+
+// Memory
+
+typedef union memoryHeader {
+    struct {
+        size_t size;
+        Uint32 category;
+    } info;
+    Uint8 align[16];
+} memoryHeader;
+
+static void* memoryDefaultAlloc(size_t size, void* user) {
+    (void)user;
+    return malloc(size);
+}
+
+static void* memoryDefaultResize(void* p, size_t size, void* user) {
+    (void)user;
+    return realloc(p, size);
+}
+
+static void memoryDefaultRelease(void* p, void* user) {
+    (void)user;
+    free(p);
+}
+
+static allocator memoryAllocator = { memoryDefaultAlloc, memoryDefaultResize, memoryDefaultRelease, NULL };
+static memoryStats memoryCounters;
+static size_t memoryLive;
+static size_t memoryAllocCalls;
+static size_t memoryAllocMark;
+static SDL_SpinLock memoryLock;
+
+static void memoryCount(memoryCategory category, size_t size, int sign) {
+    SDL_AtomicLock(&memoryLock);
+
+    if (sign > 0) {
+        memoryCounters.bytes[category] += size;
+        memoryCounters.allocations[category]++;
+        memoryAllocCalls++;
+        memoryLive += size;
+        memoryCounters.peakBytes = SDL_max(memoryCounters.peakBytes, memoryLive);
+    }
+    else {
+        memoryCounters.bytes[category] -= size;
+        memoryCounters.allocations[category]--;
+        memoryLive -= size;
+    }
+
+    SDL_AtomicUnlock(&memoryLock);
+}
+
+bool setAllocator(const allocator* a) {
+    static const allocator standard = { memoryDefaultAlloc, memoryDefaultResize, memoryDefaultRelease, NULL };
+
+    if (memoryLive > 0 || (a && (!a->alloc || !a->resize || !a->release))) {
+        return FALSE;
+    }
+
+    memoryAllocator = a ? *a : standard;
+
+    return TRUE;
+}
+
+void* memoryAlloc(memoryCategory category, size_t size) {
+    memoryHeader* h;
+
+    if (category >= MEMORY_CATEGORIES || size > SIZE_MAX - sizeof(memoryHeader)) {
+        return NULL;
+    }
+
+    h = memoryAllocator.alloc(sizeof(memoryHeader) + size, memoryAllocator.user);
+
+    if (!h) {
+        return NULL;
+    }
+
+    h->info.size = size;
+    h->info.category = category;
+    memoryCount(category, size, 1);
+
+    return h + 1;
+}
+
+void* memoryCalloc(memoryCategory category, size_t count, size_t size) {
+    void* p = count && size > SIZE_MAX / count ? NULL : memoryAlloc(category, count * size);
+
+    if (p) {
+        memset(p, 0, count * size);
+    }
+
+    return p;
+}
+
+void* memoryRealloc(memoryCategory category, void* p, size_t size) {
+    memoryHeader* h;
+
+    if (!p) {
+        return memoryAlloc(category, size);
+    }
+
+    if (size > SIZE_MAX - sizeof(memoryHeader)) {
+        return NULL;
+    }
+
+    h = (memoryHeader*)p - 1;
+    memoryCategory previous = h->info.category;
+    size_t old = h->info.size;
+
+    h = memoryAllocator.resize(h, sizeof(memoryHeader) + size, memoryAllocator.user);
+
+    if (!h) {
+        return NULL;
+    }
+
+    memoryCount(previous, old, -1);
+    h->info.size = size;
+    memoryCount(previous, size, 1);
+
+    return h + 1;
+}
+
+void memoryFree(void* p) {
+    if (p) {
+        memoryHeader* h = (memoryHeader*)p - 1;
+        memoryCount(h->info.category, h->info.size, -1);
+        memoryAllocator.release(h, memoryAllocator.user);
+    }
+}
+
+static size_t memoryTextureSize(SDL_Texture* t) {
+    Uint32 format;
+    int w;
+    int h;
+
+    if (SDL_QueryTexture(t, &format, NULL, &w, &h) < 0) {
+        return 0;
+    }
+
+    return (size_t)w * h * SDL_max(SDL_BYTESPERPIXEL(format), 1);
+}
+
+static SDL_Texture* memoryTexture(SDL_Texture* t) {
+    if (t) {
+        size_t size = memoryTextureSize(t);
+
+        SDL_AtomicLock(&memoryLock);
+        memoryCounters.textures++;
+        memoryCounters.textureBytes += size;
+        SDL_AtomicUnlock(&memoryLock);
+    }
+
+    return t;
+}
+
+static void memoryDestroyTexture(SDL_Texture* t) {
+    if (t) {
+        size_t size = memoryTextureSize(t);
+
+        SDL_AtomicLock(&memoryLock);
+        memoryCounters.textures--;
+        memoryCounters.textureBytes -= size;
+        SDL_AtomicUnlock(&memoryLock);
+        SDL_DestroyTexture(t);
+    }
+}
+
+static SDL_Surface* memorySurface(SDL_Surface* s) {
+    if (s) {
+        SDL_AtomicLock(&memoryLock);
+        memoryCounters.surfaces++;
+        memoryCounters.surfaceBytes += (size_t)s->pitch * s->h;
+        memoryCounters.surfacePeakBytes = SDL_max(memoryCounters.surfacePeakBytes, memoryCounters.surfaceBytes);
+        SDL_AtomicUnlock(&memoryLock);
+    }
+
+    return s;
+}
+
+static void memoryFreeSurface(SDL_Surface* s) {
+    if (s) {
+        SDL_AtomicLock(&memoryLock);
+        memoryCounters.surfaces--;
+        memoryCounters.surfaceBytes -= (size_t)s->pitch * s->h;
+        SDL_AtomicUnlock(&memoryLock);
+        SDL_FreeSurface(s);
+    }
+}
+
+static void memoryFrameEnd(void) {
+    SDL_AtomicLock(&memoryLock);
+    memoryCounters.frameAllocations = memoryAllocCalls - memoryAllocMark;
+    memoryAllocMark = memoryAllocCalls;
+    SDL_AtomicUnlock(&memoryLock);
+}
+
+memoryStats memoryGetStats(void) {
+    memoryStats stats;
+
+    SDL_AtomicLock(&memoryLock);
+    stats = memoryCounters;
+    SDL_AtomicUnlock(&memoryLock);
+
+    return stats;
+}
+
+static bool statsOverlay;
+
+void setStatsOverlay(bool enabled) {
+    statsOverlay = enabled;
+}
+
+static void memoryOverlayLine(vector2* at, const char* format, ...) {
+    char line[96];
+    va_list args;
+
+    va_start(args, format);
+    SDL_vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    drawText(fontDefault(), line, *at, 2, rgb(255, 255, 255));
+    at->y += 18;
+}
+
+static void memoryOverlay(void) {
+    static const char* names[MEMORY_CATEGORIES] = { "general", "render", "geometry", "textures", "text", "animation", "audio", "assets", "game" };
+    memoryStats stats = memoryGetStats();
+    frameArenaStats arena = frameArenaGetStats();
+    vector2 at = { 8, 8 };
+    double mb = 1.0 / (1024 * 1024);
+    size_t heap = 0;
+
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        heap += stats.bytes[i];
+    }
+
+    memoryOverlayLine(&at, "frame %.2f ms", frameDelta * 1000.0f);
+    memoryOverlayLine(&at, "heap %.2f MB, peak %.2f MB", heap * mb, stats.peakBytes * mb);
+    memoryOverlayLine(&at, "textures %d, %.2f MB", stats.textures, stats.textureBytes * mb);
+    memoryOverlayLine(&at, "surfaces %d, %.2f MB, peak %.2f MB", stats.surfaces, stats.surfaceBytes * mb, stats.surfacePeakBytes * mb);
+    memoryOverlayLine(&at, "arena %.1f KB, peak %.1f KB", arena.used / 1024.0, arena.peak / 1024.0);
+    memoryOverlayLine(&at, "heap allocations last frame %lu", (unsigned long)stats.frameAllocations);
+
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        if (stats.allocations[i] > 0) {
+            memoryOverlayLine(&at, "  %s %.1f KB in %lu", names[i], stats.bytes[i] / 1024.0, (unsigned long)stats.allocations[i]);
+        }
+    }
+}
+
+// Arena
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK (64 * 1024)
+
+typedef struct arenaBlock {
+    struct arenaBlock* next;
+    size_t size;
+    size_t used;
+} arenaBlock;
+
+typedef struct arena {
+    arenaBlock* head;
+    size_t used;
+    size_t peak;
+    size_t capacity;
+} arena;
+
+#define ARENA_HEADER ((sizeof(arenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static arena frameArenas[3];
+static int frameParity;
+
+// Aligns the address rather than the offset, so alignments above the block
+// header's own alignment hold too.
+static size_t arenaOffset(const arenaBlock* b, size_t align) {
+    uintptr_t base = (uintptr_t)((const Uint8*)b + ARENA_HEADER);
+    return (size_t)(((base + b->used + align - 1) & ~(uintptr_t)(align - 1)) - base);
+}
+
+static void* arenaAlloc(arena* a, size_t size, size_t align) {
+    arenaBlock* b = a->head;
+    size_t start;
+
+    if (align < ARENA_ALIGN || (align & (align - 1))) {
+        align = ARENA_ALIGN;
+    }
+
+    start = b ? arenaOffset(b, align) : 0;
+
+    if (!b || start > b->size || size > b->size - start) {
+        size_t blockSize = SDL_max((size_t)ARENA_BLOCK, size + align);
+
+        if (size > SIZE_MAX - ARENA_HEADER - align || !(b = memoryAlloc(MEMORY_GENERAL, ARENA_HEADER + blockSize))) {
+            return NULL;
+        }
+
+        b->next = a->head;
+        b->size = blockSize;
+        b->used = 0;
+        a->head = b;
+        a->capacity += blockSize;
+        start = arenaOffset(b, align);
+    }
+
+    a->used += start + size - b->used;
+    a->peak = SDL_max(a->peak, a->used);
+    b->used = start + size;
+
+    return (Uint8*)b + ARENA_HEADER + start;
+}
+
+static void arenaRelease(arena* a, arenaBlock* keep) {
+    while (a->head && a->head != keep) {
+        arenaBlock* next = a->head->next;
+
+        a->capacity -= a->head->size;
+        memoryFree(a->head);
+        a->head = next;
+    }
+}
+
+// A frame that spilled into more than one block gets a single block the size
+// of the peak next time, so steady frames allocate nothing.
+// A rewind can free the spill blocks and leave one small head behind, so the
+// peak decides the regrow as well as the block count.
+static void arenaReset(arena* a) {
+    if (a->peak > 0 && (!a->head || a->head->next || a->peak > a->head->size)) {
+        size_t size = SDL_max(a->peak + a->peak / 4, (size_t)ARENA_BLOCK);
+
+        arenaRelease(a, NULL);
+        a->head = memoryAlloc(MEMORY_GENERAL, ARENA_HEADER + size);
+
+        if (a->head) {
+            a->head->next = NULL;
+            a->head->size = size;
+            a->capacity = size;
+        }
+        else {
+            a->capacity = 0;
+        }
+    }
+
+    if (a->head) {
+        a->head->used = 0;
+    }
+
+    a->used = 0;
+}
+
+static void frameArenaReset(void) {
+    frameParity ^= 1;
+    arenaReset(&frameArenas[0]);
+    arenaReset(&frameArenas[1 + frameParity]);
+    memoryFrameEnd();
+}
+
+void* frameAlloc(size_t size) {
+    return arenaAlloc(&frameArenas[0], size, ARENA_ALIGN);
+}
+
+void* frameAllocAligned(size_t size, size_t align) {
+    return arenaAlloc(&frameArenas[0], size, align);
+}
+
+void* frameAllocDouble(size_t size) {
+    return arenaAlloc(&frameArenas[1 + frameParity], size, ARENA_ALIGN);
+}
+
+char* frameString(const char* format, ...) {
+    va_list args;
+    char* text;
+
+    va_start(args, format);
+    int length = SDL_vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (length < 0 || !(text = frameAlloc((size_t)length + 1))) {
+        return NULL;
+    }
+
+    va_start(args, format);
+    SDL_vsnprintf(text, (size_t)length + 1, format, args);
+    va_end(args);
+
+    return text;
+}
+
+frameMark frameArenaMark(void) {
+    arena* a = &frameArenas[0];
+    frameMark m = { a->head, a->head ? a->head->used : 0, a->used };
+    return m;
+}
+
+void frameArenaRewind(frameMark m) {
+    arena* a = &frameArenas[0];
+    arenaBlock* b = a->head;
+
+    while (b && b != m.block) {
+        b = b->next;
+    }
+
+    if (b != m.block || m.used > a->used || (b && m.offset > b->used)) {
+        return;
+    }
+
+    arenaRelease(a, m.block);
+
+    if (a->head) {
+        a->head->used = m.offset;
+    }
+
+    a->used = m.used;
+}
+
+frameArenaStats frameArenaGetStats(void) {
+    frameArenaStats stats;
+    arena* d = &frameArenas[1 + frameParity];
+
+    stats.used = frameArenas[0].used;
+    stats.peak = frameArenas[0].peak;
+    stats.capacity = frameArenas[0].capacity;
+    stats.doubleUsed = d->used;
+    stats.doublePeak = SDL_max(frameArenas[1].peak, frameArenas[2].peak);
+    stats.doubleCapacity = frameArenas[1].capacity + frameArenas[2].capacity;
+
+    return stats;
+}
+
+static void arenasFree(void) {
+    for (int i = 0; i < 3; i++) {
+        arenaRelease(&frameArenas[i], NULL);
+        SDL_zero(frameArenas[i]);
+    }
+}
+
+// States
+static state current;
+
+void setCurrentState(stateFunction init, stateFunction update, stateFunction exit) {
+    if (current.exit) {
+        current.exit(NULL);
+    }
+
+    current.init = init ? init : NULL;
+    current.update = update ? update : NULL;
+    current.exit = exit ? exit : NULL;
+
+    if (current.init) {
+        current.init(NULL);
+    }
+}
+
+state* getCurrentState(void) {
+    return &current;
+}
+
+// Replay
+
+#define REPLAY_MAGIC 0x4C50524E
+#define REPLAY_VERSION 2
+
+typedef enum {
+    REPLAY_OFF,
+    REPLAY_RECORDING,
+    REPLAY_PLAYING
+} replayMode;
+
+static replayMode replayState;
+static FILE* replayFile;
+static replayStats replayResult;
+static Uint64 replayStartCounter;
+static SDL_Event* replayEvents;
+static int replayEventCount;
+static int replayEventCapacity;
+
+// Replay files hold little-endian fields rather than raw SDL_Event structs, so
+// they carry no padding or timestamps and read back on any platform.
+static void replayValue(Uint8* bytes, int* at, void* value, int size, bool write) {
+    Uint8* v = value;
+
+    for (int i = 0; i < size; i++) {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        int k = size - 1 - i;
+#else
+        int k = i;
+#endif
+
+        if (write) {
+            bytes[*at + i] = v[k];
+        }
+        else {
+            v[k] = bytes[*at + i];
+        }
+    }
+
+    *at += size;
+}
+
+#define REPLAY_FIELD(field) replayValue(bytes, &at, &(field), (int)sizeof(field), write)
+#define REPLAY_EVENT_MAX 64
+
+// Moves the fields of e that the engine looks at to or from bytes and returns
+// how many bytes they take, or -1 for events that aren't recorded.
+static int replayFields(SDL_Event* e, Uint8* bytes, bool write) {
+    int at = 0;
+
+    switch (e->type) {
+        case SDL_QUIT:
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            REPLAY_FIELD(e->key.state);
+            REPLAY_FIELD(e->key.repeat);
+            REPLAY_FIELD(e->key.keysym.scancode);
+            REPLAY_FIELD(e->key.keysym.sym);
+            REPLAY_FIELD(e->key.keysym.mod);
+            break;
+        case SDL_TEXTINPUT:
+            for (int i = 0; i < SDL_TEXTINPUTEVENT_TEXT_SIZE; i++) {
+                REPLAY_FIELD(e->text.text[i]);
+            }
+            break;
+        case SDL_MOUSEMOTION:
+            REPLAY_FIELD(e->motion.which);
+            REPLAY_FIELD(e->motion.state);
+            REPLAY_FIELD(e->motion.x);
+            REPLAY_FIELD(e->motion.y);
+            REPLAY_FIELD(e->motion.xrel);
+            REPLAY_FIELD(e->motion.yrel);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            REPLAY_FIELD(e->button.which);
+            REPLAY_FIELD(e->button.button);
+            REPLAY_FIELD(e->button.state);
+            REPLAY_FIELD(e->button.clicks);
+            REPLAY_FIELD(e->button.x);
+            REPLAY_FIELD(e->button.y);
+            break;
+        case SDL_MOUSEWHEEL:
+            REPLAY_FIELD(e->wheel.which);
+            REPLAY_FIELD(e->wheel.x);
+            REPLAY_FIELD(e->wheel.y);
+            REPLAY_FIELD(e->wheel.direction);
+            REPLAY_FIELD(e->wheel.preciseX);
+            REPLAY_FIELD(e->wheel.preciseY);
+            REPLAY_FIELD(e->wheel.mouseX);
+            REPLAY_FIELD(e->wheel.mouseY);
+            break;
+        case SDL_CONTROLLERAXISMOTION:
+            REPLAY_FIELD(e->caxis.which);
+            REPLAY_FIELD(e->caxis.axis);
+            REPLAY_FIELD(e->caxis.value);
+            break;
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            REPLAY_FIELD(e->cbutton.which);
+            REPLAY_FIELD(e->cbutton.button);
+            REPLAY_FIELD(e->cbutton.state);
+            break;
+        case SDL_CONTROLLERDEVICEADDED:
+        case SDL_CONTROLLERDEVICEREMOVED:
+        case SDL_CONTROLLERDEVICEREMAPPED:
+            REPLAY_FIELD(e->cdevice.which);
+            break;
+        default:
+            return -1;
+    }
+
+    return at;
+}
+
+#undef REPLAY_FIELD
+
+static int replayEventSize(Uint32 type) {
+    Uint8 bytes[REPLAY_EVENT_MAX];
+    SDL_Event e;
+
+    SDL_zero(e);
+    e.type = type;
+
+    return replayFields(&e, bytes, TRUE);
+}
+
+static bool replayWrite(void* value, int size) {
+    Uint8 bytes[sizeof(Uint32)];
+    int at = 0;
+
+    replayValue(bytes, &at, value, size, TRUE);
+
+    return fwrite(bytes, (size_t)size, 1, replayFile) == 1;
+}
+
+static bool replayRead(void* value, int size) {
+    Uint8 bytes[sizeof(Uint32)];
+    int at = 0;
+
+    if (fread(bytes, (size_t)size, 1, replayFile) != 1) {
+        return FALSE;
+    }
+
+    replayValue(bytes, &at, value, size, FALSE);
+
+    return TRUE;
+}
+
+static bool replayPushEvent(SDL_Event* e) {
+    if (replayEventCount == replayEventCapacity) {
+        int capacity = replayEventCapacity ? replayEventCapacity * 2 : 64;
+        SDL_Event* events = memoryRealloc(MEMORY_GENERAL, replayEvents, capacity * sizeof(SDL_Event));
+
+        if (!events) {
+            return FALSE;
+        }
+
+        replayEvents = events;
+        replayEventCapacity = capacity;
+    }
+
+    replayEvents[replayEventCount++] = *e;
+    return TRUE;
+}
+
+static bool replayOpen(const char* path, replayMode mode) {
+    replayStop();
+
+    replayFile = fopen(path, mode == REPLAY_RECORDING ? "wb" : "rb");
+
+    if (!replayFile) {
+        return FALSE;
+    }
+
+    Uint32 header[2] = { REPLAY_MAGIC, REPLAY_VERSION };
+
+    if (mode == REPLAY_RECORDING) {
+        if (!replayWrite(&header[0], sizeof(Uint32)) || !replayWrite(&header[1], sizeof(Uint32))) {
+            fclose(replayFile);
+            replayFile = NULL;
+            return FALSE;
+        }
+    }
+    else if (!replayRead(&header[0], sizeof(Uint32)) || !replayRead(&header[1], sizeof(Uint32)) ||
+             header[0] != REPLAY_MAGIC || header[1] != REPLAY_VERSION) {
+        fclose(replayFile);
+        replayFile = NULL;
+        return FALSE;
+    }
+
+    replayState = mode;
+    replayEventCount = 0;
+    replayResult.frames = 0;
+    replayResult.seconds = 0.0;
+    replayStartCounter = SDL_GetPerformanceCounter();
+
+    return TRUE;
+}
+
+bool replayRecord(const char* path) {
+    return replayOpen(path, REPLAY_RECORDING);
+}
+
+bool replayPlay(const char* path) {
+    return replayOpen(path, REPLAY_PLAYING);
+}
+
+void replayStop(void) {
+    if (replayState == REPLAY_OFF) {
+        return;
+    }
+
+    replayResult.seconds = (double)(SDL_GetPerformanceCounter() - replayStartCounter) / SDL_GetPerformanceFrequency();
+
+    if (replayState == REPLAY_PLAYING) {
+        SDL_Log("replay: %u frames in %.3f s (%.1f fps)",
+                replayResult.frames,
+                replayResult.seconds,
+                replayResult.seconds > 0.0 ? replayResult.frames / replayResult.seconds : 0.0);
+    }
+
+    fclose(replayFile);
+    replayFile = NULL;
+    replayState = REPLAY_OFF;
+    replayEventCount = 0;
+}
+
+bool replayIsPlaying(void) {
+    return replayState == REPLAY_PLAYING;
+}
+
+replayStats replayGetStats(void) {
+    return replayResult;
+}
+
+// A write error ends the recording there rather than leaving a file that
+// falls out of step part way through.
+static void replayWriteFrame(float dt) {
+    Uint32 count = (Uint32)replayEventCount;
+    bool written = replayWrite(&dt, sizeof(dt)) && replayWrite(&count, sizeof(count));
+
+    for (int i = 0; written && i < replayEventCount; i++) {
+        Uint8 bytes[REPLAY_EVENT_MAX];
+        int size = replayFields(&replayEvents[i], bytes, TRUE);
+
+        written = replayWrite(&replayEvents[i].type, sizeof(Uint32)) && (size == 0 || fwrite(bytes, (size_t)size, 1, replayFile) == 1);
+    }
+
+    replayEventCount = 0;
+
+    if (!written) {
+        SDL_Log("replay: write failed after %u frames", replayResult.frames);
+        replayStop();
+        return;
+    }
+
+    replayResult.frames++;
+}
+
+static bool replayReadFrame(float* dt) {
+    Uint32 count;
+
+    replayEventCount = 0;
+
+    if (!replayRead(dt, sizeof(*dt)) || !replayRead(&count, sizeof(count)) || count > (Uint32)SDL_MAX_SINT32) {
+        return FALSE;
+    }
+
+    for (Uint32 i = 0; i < count; i++) {
+        Uint8 bytes[REPLAY_EVENT_MAX];
+        SDL_Event e;
+        int size;
+
+        SDL_zero(e);
+
+        if (!replayRead(&e.type, sizeof(e.type))) {
+            return FALSE;
+        }
+
+        size = replayEventSize(e.type);
+
+        if (size < 0 || (size > 0 && fread(bytes, (size_t)size, 1, replayFile) != 1)) {
+            return FALSE;
+        }
+
+        replayFields(&e, bytes, FALSE);
+
+        if (!replayPushEvent(&e)) {
+            return FALSE;
+        }
+    }
+
+    replayResult.frames++;
+
+    return TRUE;
+}
+
+// Loop
+
+static color backgroundColor;
+static bool headless;
+static bool dirtyRectMode;
+static bool pipelinedMode;
+static bool rasterMode;
+static SDL_threadID renderThread;
+static SDL_Thread* updateThread;
+static SDL_mutex* pipelineLock;
+static SDL_cond* pipelineSignal;
+static bool updateRequested;
+static bool updateFinished;
+static bool pipelineQuit;
+static void (*pipelineTask)(void*);
+static void* pipelineTaskData;
+static void (*lateLatch)(void);
+int imgFlags;
+
+void setBackgroundColor(color c) {
+    backgroundColor = c;
+}
+
+void setHeadless(bool h) {
+    headless = h;
+}
+
+void setDirtyRectMode(bool enabled) {
+    dirtyRectMode = enabled;
+}
+
+void setPipelinedMode(bool enabled) {
+    pipelinedMode = enabled;
+}
+
+void setSoftwareRasterizer(bool enabled) {
+    rasterMode = enabled;
+}
+
+void setLateLatch(void (*latch)(void)) {
+    lateLatch = latch;
+}
+
+static nest* initializedNest;
+
+int initNest(nest* n, const char* title, int width, int height) {
+    if (!n) {
+        return -1;
+    }
+
+    if (headless) {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+        SDL_SetHint(SDL_HINT_AUDIODRIVER, "dummy");
+    }
+
+    if (rasterMode) {
+        dirtyRectMode = FALSE;
+    }
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        return -1;
+    }
+
+    else {
+        n->window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, headless ? SDL_WINDOW_HIDDEN : 0);
+
+        if (!n->window) {
+            return -1;
+        }
+
+        if (dirtyRectMode) {
+            n->renderer = SDL_CreateRenderer(n->window, -1, SDL_RENDERER_SOFTWARE);
+        }
+        else {
+            n->renderer = SDL_CreateRenderer(n->window, -1, headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
+        }
+
+        if (!n->renderer) {
+            return -1;
+        }
+
+        imgFlags = IMG_INIT_PNG;
+        
+        if (!(IMG_Init(imgFlags) && imgFlags)) {
+            return -1;
+        }
+    }
+
+    inputApplyFilter();
+    backgroundColor = rgb(0, 0, 0);
+
+    initializedNest = n;
+    renderThread = SDL_ThreadID();
+
+    return 0;
+}
+
+static bool nestBeginFrame(Uint64* lastCounter) {
+    Uint64 counter = SDL_GetPerformanceCounter();
+
+    frameArenaReset();
+    frameDelta = (float)(counter - *lastCounter) / SDL_GetPerformanceFrequency();
+    *lastCounter = counter;
+
+    return replayState != REPLAY_PLAYING || replayReadFrame(&frameDelta);
+}
+
+static bool nestDispatchEvent(SDL_Event* e) {
+    if (e->type == SDL_RENDER_TARGETS_RESET || e->type == SDL_RENDER_DEVICE_RESET) {
+        layersInvalidate(e->type == SDL_RENDER_DEVICE_RESET);
+        tilemapsInvalidate(e->type == SDL_RENDER_DEVICE_RESET);
+        postsInvalidate(e->type == SDL_RENDER_DEVICE_RESET);
+        commandsInvalidate();
+    }
+
+    if (e->type == SDL_WINDOWEVENT && (e->window.event == SDL_WINDOWEVENT_EXPOSED || e->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+        commandsInvalidate();
+    }
+
+    if (replayState == REPLAY_RECORDING && replayEventSize(e->type) >= 0) {
+        replayPushEvent(e);
+    }
+
+    if (replayState != REPLAY_PLAYING) {
+        inputHandleEvent(e);
+    }
+
+    return e->type != SDL_QUIT;
+}
+
+static bool nestPollEvents(void) {
+    bool running = TRUE;
+    SDL_Event e;
+
+    traceBegin("poll");
+    inputBeginFrame();
+
+    while(SDL_PollEvent(&e) > 0)
+    {
+        if (!nestDispatchEvent(&e)) {
+            running = FALSE;
+        }
+    }
+
+    if (replayState == REPLAY_PLAYING) {
+        for (int i = 0; i < replayEventCount; i++) {
+            if (replayEvents[i].type == SDL_QUIT) {
+                running = FALSE;
+            }
+
+            inputHandleEvent(&replayEvents[i]);
+        }
+    }
+    else if (replayState == REPLAY_RECORDING) {
+        replayWriteFrame(frameDelta);
+    }
+
+    inputEndFrame();
+    traceEnd("poll");
+
+    return running;
+}
+
+static void nestClear(void) {
+    if (rasterMode) {
+        rasterClear(backgroundColor);
+    }
+    else if (!dirtyRectMode) {
+        postBegin();
+        SDL_SetRenderDrawColor(initializedNest->renderer, backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
+        SDL_RenderClear(initializedNest->renderer);
+    }
+}
+
+static void nestUpdate(void) {
+    traceBegin("update");
+    tweensUpdate(frameDelta);
+    animationsUpdate(frameDelta);
+
+    if (current.update) {
+        current.update(NULL);
+    }
+
+    if (statsOverlay) {
+        memoryOverlay();
+    }
+
+    traceEnd("update");
+}
+
+// Recorded and replayed runs skip the latch, since what it samples never
+// makes it into the replay file.
+static void nestLateLatch(void) {
+    if (lateLatch && replayState == REPLAY_OFF) {
+        inputLatch();
+        lateLatch();
+    }
+}
+
+static void nestRender(void) {
+    traceBegin("render");
+    spriteBatchFlush();
+    geometryFlush();
+    textBatchFlush();
+
+    if (rasterMode) {
+        rasterPresent();
+    }
+    else {
+        postEnd();
+    }
+
+    traceEnd("render");
+}
+
+static void nestPresent(void) {
+    traceBegin("present");
+
+    if (dirtyRectMode) {
+        commandsPresentDirty(initializedNest->window);
+    }
+    else {
+        SDL_RenderPresent(initializedNest->renderer);
+        commandsEndFrame(FALSE);
+    }
+
+    traceEnd("present");
+}
+
+static void runSequential(void) {
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+
+    while (nestBeginFrame(&lastCounter) && nestPollEvents())
+    {
+        commandsBeginFrame(dirtyRectMode);
+        nestClear();
+        nestUpdate();
+        nestLateLatch();
+
+        if (!dirtyRectMode) {
+            nestRender();
+        }
+
+        nestPresent();
+    }
+}
+
+static int pipelineUpdate(void* data) {
+    (void)data;
+
+    SDL_LockMutex(pipelineLock);
+
+    while (!pipelineQuit) {
+        if (!updateRequested) {
+            SDL_CondWait(pipelineSignal, pipelineLock);
+            continue;
+        }
+
+        updateRequested = FALSE;
+        SDL_UnlockMutex(pipelineLock);
+
+        nestUpdate();
+
+        SDL_LockMutex(pipelineLock);
+        updateFinished = TRUE;
+        SDL_CondBroadcast(pipelineSignal);
+    }
+
+    SDL_UnlockMutex(pipelineLock);
+
+    return 0;
+}
+
+static void pipelineKick(void) {
+    SDL_LockMutex(pipelineLock);
+    updateRequested = TRUE;
+    SDL_CondBroadcast(pipelineSignal);
+    SDL_UnlockMutex(pipelineLock);
+}
+
+static void pipelineWait(void) {
+    SDL_LockMutex(pipelineLock);
+
+    while (!updateFinished) {
+        if (pipelineTask) {
+            SDL_UnlockMutex(pipelineLock);
+            pipelineTask(pipelineTaskData);
+            SDL_LockMutex(pipelineLock);
+
+            pipelineTask = NULL;
+            SDL_CondBroadcast(pipelineSignal);
+            continue;
+        }
+
+        SDL_CondWait(pipelineSignal, pipelineLock);
+    }
+
+    updateFinished = FALSE;
+    SDL_UnlockMutex(pipelineLock);
+}
+
+static void renderThreadCall(void (*task)(void*), void* data) {
+    if (!updateThread || SDL_ThreadID() == renderThread) {
+        task(data);
+        return;
+    }
+
+    SDL_LockMutex(pipelineLock);
+    pipelineTask = task;
+    pipelineTaskData = data;
+    SDL_CondBroadcast(pipelineSignal);
+
+    while (pipelineTask) {
+        SDL_CondWait(pipelineSignal, pipelineLock);
+    }
+
+    SDL_UnlockMutex(pipelineLock);
+}
+
+static void runPipelined(void) {
+    bool running = TRUE;
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+
+    pipelineLock = SDL_CreateMutex();
+    pipelineSignal = SDL_CreateCond();
+    pipelineQuit = FALSE;
+    updateRequested = FALSE;
+    updateFinished = FALSE;
+    updateThread = pipelineLock && pipelineSignal ? SDL_CreateThread(pipelineUpdate, "nest update", NULL) : NULL;
+
+    if (!updateThread) {
+        SDL_DestroyCond(pipelineSignal);
+        SDL_DestroyMutex(pipelineLock);
+        pipelineSignal = NULL;
+        pipelineLock = NULL;
+        runSequential();
+        return;
+    }
+
+    // Frames begin and poll in the same order as runSequential, so a replay
+    // pairs each delta with the events its update sees in either mode.
+    if (nestBeginFrame(&lastCounter) && nestPollEvents()) {
+        commandsBeginFrame(TRUE);
+        pipelineKick();
+        pipelineWait();
+
+        while(running)
+        {
+            running = nestBeginFrame(&lastCounter) && nestPollEvents();
+            commandsBeginFrame(TRUE);
+
+            color clear = backgroundColor;
+
+            if (running) {
+                pipelineKick();
+            }
+
+            traceBegin("render");
+            postBegin();
+            SDL_SetRenderDrawColor(initializedNest->renderer, clear.r, clear.g, clear.b, clear.a);
+            SDL_RenderClear(initializedNest->renderer);
+
+            if (rasterMode) {
+                rasterClear(clear);
+                commandsRenderSubmitted();
+                rasterPresent();
+            }
+            else {
+                commandsRenderSubmitted();
+                postEnd();
+            }
+
+            traceEnd("render");
+            traceBegin("present");
+            SDL_RenderPresent(initializedNest->renderer);
+            commandsEndFrame(TRUE);
+            traceEnd("present");
+
+            if (running) {
+                pipelineWait();
+            }
+        }
+    }
+
+    SDL_LockMutex(pipelineLock);
+    pipelineQuit = TRUE;
+    SDL_CondBroadcast(pipelineSignal);
+    SDL_UnlockMutex(pipelineLock);
+
+    SDL_WaitThread(updateThread, NULL);
+    SDL_DestroyCond(pipelineSignal);
+    SDL_DestroyMutex(pipelineLock);
+    updateThread = NULL;
+    pipelineSignal = NULL;
+    pipelineLock = NULL;
+    commandsBeginFrame(FALSE);
+}
+
+void runNest(void) {
+    if (initializedNest) {
+        if (pipelinedMode && !dirtyRectMode) {
+            runPipelined();
+        }
+        else {
+            runSequential();
+        }
+
+        replayStop();
+    }
+}
+
+void cleanNest(void) {
+    if (initializedNest) {
+        if (current.exit) {
+            current.exit(NULL);
+        }
+
+        replayStop();
+        memoryFree(replayEvents);
+        replayEvents = NULL;
+        replayEventCapacity = 0;
+        geometryFree();
+        layersFree();
+        tilemapsFree();
+        commandsFree();
+        spritesFree();
+        textsFree();
+        rasterFree();
+        postsFree();
+        animationsFree();
+        tweensFree();
+        inputFree();
+        audioFree();
+        tracesFree();
+        arenasFree();
+        jobsFree();
+        packsFree();
+        textureInfoFree();
+
+        SDL_DestroyRenderer(initializedNest->renderer);
+        SDL_DestroyWindow(initializedNest->window);
+        IMG_Quit();
+        SDL_Quit();
+    }
+}
+
+// Vector
+
+vector2 vectorZero(void) {
+    return (vector2){ 0, 0 };
+}
+
+vector2 vectorUp(void) {
+    return (vector2){ 0, 1 };
+}
+
+vector2 vectorRight(void) {
+    return (vector2){ 1, 0 };
+}
+
+void vectorSet(vector2* a, float x, float y) {
+    if (a) {
+        a->x = x;
+        a->y = y;
+    }
+}
+
+void vectorNeg(vector2* a) {
+    if (a) {
+        a->x = -a->x;
+        a->y = -a->y;
+    }
+}
+
+void vectorAdd(vector2* a, vector2* b1, vector2* b2) {
+    if (a && b1 && b2) {
+        a->x = b1->x + b2->x;
+        a->y = b1->y + b2->y;
+    }
+}
+
+void vectorSub(vector2* a, vector2* b1, vector2* b2) {
+    if (a && b1 && b2) {
+        a->x = b1->x - b2->x;
+        a->y = b1->y - b2->y;
+    }
+}
+
+void vectorNormalize(vector2* a) {
+    if (a) {
+        float length = sqrtf(powf(a->x, 2) + powf(a->x, 2));
+
+        if (length <= 0) {
+            vectorZero();
+        }
+        else {
+            a->x = (a->x / length);
+            a->y = (a->y / length);
+        }
+    }
+}
+
+void vectorScale(vector2* a, float scale) {
+    if (a) {
+        a->x = a->x * scale;
+        a->y = a->y * scale;
+    }
+}
+
+float vectorLength(vector2* a) {
+    if (a) {
+        return sqrtf(powf(a->x, 2) + powf(a->x, 2));
+    }
+
+    return 0.0f;
+}
+
+float vectorDistance(vector2* a, vector2* b) {
+    if (a && b) {
+        float dx = b->x - a->x;
+        float dy = b->y - a->y;
+
+        return sqrtf(powf(dx, 2) + powf(dy, 2));
+    }
+
+    return 0.0f;
+}
+
+float vectorDotProd(vector2* a, vector2* b) {
+    if (a && b) {
+        return (a->x * b->x) + (a->y * b->y);
+    }
+
+    return 0.0f;
+}
+
+void vectorLerp(vector2* result, vector2* a, vector2* b, float t) {
+    if (result && a && b) {
+        result->x = lerpf(a->x, b->x, t);
+        result->y = lerpf(a->y, b->y, t);
+    }
+}
+
+// Angles
+
+float angleDegtoRad(angle deg) {
+    if (deg) {
+        return *deg * (M_PI/180);
+    }
+
+    return 0.0f;
+}
+
+float angleRadtoDeg(angle rad) {
+    if (rad) {
+        return *rad * (180/M_PI);
+    }
+
+    return 0.0f;
+}
+
+float angleShortestDistance(angle a, angle b) {
+    float diff = fmodf(*b - *a + 180.0f, 360.0f) - 180.0f;
+    return diff < -180.0f ? diff + 360.0f : diff;
+}
+
+float angleShortestDistanceRad(angle a, angle b) {
+    float diff = fmodf(*b - *a + M_PI, 2 * M_PI) - M_PI;
+    return diff < -M_PI ? diff + 2 * M_PI : diff;
+}
+
+float angleNormalizeDeg(angle deg) {
+    return fmodf(*deg + 360.0f, 360.0f);
+}
+
+float angleNormalizeRad(angle rad) {
+    return fmodf(*rad + 2 * M_PI, 2 * M_PI);
+}
+
+float angleNormalizeDegSigned(angle deg) {
+    float normalized = fmodf(*deg + 180.0f, 360.0f) - 180.0f;
+    return normalized < -180.0f ? normalized + 360.0f : normalized;
+}
+
+float angleNormalizeRadSigned(angle rad) {
+    float normalized = fmodf(*rad + M_PI, 2 * M_PI) - M_PI;
+    return normalized < -M_PI ? normalized + 2 * M_PI : normalized;
+}
+
+void angleToVector(vector2* v, angle deg) {
+    if (v) {
+        float rad = *deg * (M_PI / 180.0f);
+        v->x = cosf(rad);
+        v->y = sinf(rad);
+    }
+}
+
+void angleToVectorRad(vector2* v, angle rad) {
+    if (v) {
+        v->x = cosf(*rad);
+        v->y = sinf(*rad);
+    }
+}
+
+float angleLerp(angle a, angle b, float t) {
+    float shortest = angleShortestDistance(a, b);
+    return *a + t * shortest;
+}
+
+float angleLerpRad(angle a, angle b, float t) {
+    float shortest = angleShortestDistanceRad(a, b);
+    return *a + t * shortest;
+}
+
+// Entities
 
 entity entityInit(int id, vector2 pos) {
     entity e;
@@ -340,217 +1827,7459 @@ entity entityInit(int id, vector2 pos) {
     return e;
 }
 
-void entityActive(entity *e, bool isActive) {
-    if (isActive == FALSE) {
-        e->isActive = FALSE;
-    } else {
-        e->isActive = TRUE;
+void entityActive(entity *e, bool isActive) {
+    if (isActive == FALSE) {
+        e->isActive = FALSE;
+    } else {
+        e->isActive = TRUE;
+    }
+}
+
+bool entityIsActive(const entity *e) {
+    return e->isActive;
+}
+
+bool entityCompare(const entity *a, const entity *b) {
+    return a->id == b->id &&
+           a->position.x == b->position.x &&
+           a->position.y == b->position.y &&
+           a->isActive == b->isActive;
+}
+
+// Jobs
+
+#define JOB_MAX_WORKERS 15
+
+static SDL_Thread* jobThreads[JOB_MAX_WORKERS];
+static int jobWorkerCount = -1;
+static SDL_mutex* jobLock;
+static SDL_cond* jobStart;
+static SDL_cond* jobDone;
+static SDL_atomic_t jobBusy;
+static SDL_atomic_t jobNext;
+static void (*jobTask)(void*, int);
+static void* jobData;
+static int jobCount;
+static int jobActive;
+static Uint32 jobGeneration;
+static bool jobQuit;
+
+static void jobsDrain(void) {
+    for (int i = SDL_AtomicAdd(&jobNext, 1); i < jobCount; i = SDL_AtomicAdd(&jobNext, 1)) {
+        jobTask(jobData, i);
+    }
+}
+
+static int jobWorker(void* data) {
+    Uint32 seen = 0;
+
+    (void)data;
+    SDL_LockMutex(jobLock);
+
+    for (;;) {
+        while (!jobQuit && jobGeneration == seen) {
+            SDL_CondWait(jobStart, jobLock);
+        }
+
+        if (jobQuit) {
+            break;
+        }
+
+        seen = jobGeneration;
+        SDL_UnlockMutex(jobLock);
+
+        jobsDrain();
+
+        SDL_LockMutex(jobLock);
+
+        if (--jobActive == 0) {
+            SDL_CondSignal(jobDone);
+        }
+    }
+
+    SDL_UnlockMutex(jobLock);
+
+    return 0;
+}
+
+static bool jobsStart(void) {
+    if (jobWorkerCount >= 0) {
+        return jobWorkerCount > 0;
+    }
+
+    jobWorkerCount = 0;
+    jobLock = SDL_CreateMutex();
+    jobStart = SDL_CreateCond();
+    jobDone = SDL_CreateCond();
+
+    if (!jobLock || !jobStart || !jobDone) {
+        return FALSE;
+    }
+
+    int wanted = SDL_clamp(SDL_GetCPUCount() - 1, 0, JOB_MAX_WORKERS);
+
+    while (jobWorkerCount < wanted) {
+        jobThreads[jobWorkerCount] = SDL_CreateThread(jobWorker, "nest-job", NULL);
+
+        if (!jobThreads[jobWorkerCount]) {
+            break;
+        }
+
+        jobWorkerCount++;
+    }
+
+    return jobWorkerCount > 0;
+}
+
+static void jobsRun(void (*task)(void*, int), void* data, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    if (count == 1 || !SDL_AtomicCAS(&jobBusy, 0, 1)) {
+        for (int i = 0; i < count; i++) {
+            task(data, i);
+        }
+
+        return;
+    }
+
+    if (!jobsStart()) {
+        for (int i = 0; i < count; i++) {
+            task(data, i);
+        }
+
+        SDL_AtomicSet(&jobBusy, 0);
+        return;
+    }
+
+    SDL_LockMutex(jobLock);
+    jobTask = task;
+    jobData = data;
+    jobCount = count;
+    jobActive = jobWorkerCount;
+    SDL_AtomicSet(&jobNext, 0);
+    jobGeneration++;
+    SDL_CondBroadcast(jobStart);
+    SDL_UnlockMutex(jobLock);
+
+    jobsDrain();
+
+    SDL_LockMutex(jobLock);
+
+    while (jobActive > 0) {
+        SDL_CondWait(jobDone, jobLock);
+    }
+
+    SDL_UnlockMutex(jobLock);
+    SDL_AtomicSet(&jobBusy, 0);
+}
+
+static void jobsFree(void) {
+    if (jobLock) {
+        SDL_LockMutex(jobLock);
+        jobQuit = TRUE;
+        SDL_CondBroadcast(jobStart);
+        SDL_UnlockMutex(jobLock);
+    }
+
+    for (int i = 0; i < jobWorkerCount; i++) {
+        SDL_WaitThread(jobThreads[i], NULL);
+        jobThreads[i] = NULL;
+    }
+
+    SDL_DestroyCond(jobDone);
+    SDL_DestroyCond(jobStart);
+    SDL_DestroyMutex(jobLock);
+    jobDone = NULL;
+    jobStart = NULL;
+    jobLock = NULL;
+    jobWorkerCount = -1;
+    jobQuit = FALSE;
+}
+
+// Raster
+
+#define RASTER_TILE_SIZE 64
+
+typedef struct rasterPlane {
+    float dx;
+    float dy;
+    float c;
+} rasterPlane;
+
+typedef struct rasterTriangle {
+    rasterPlane edges[3];
+    bool topLeft[3];
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    const SDL_Surface* surface;
+    bool shaded;
+    blendMode blend;
+    Uint32 flat;
+    rasterPlane u;
+    rasterPlane v;
+    rasterPlane channels[4];
+} rasterTriangle;
+
+typedef struct rasterBin {
+    int* triangles;
+    int count;
+    int capacity;
+} rasterBin;
+
+typedef struct rasterCopy {
+    texture tex;
+    SDL_Surface* surface;
+} rasterCopy;
+
+static SDL_Texture* rasterTexture;
+static Uint32* rasterPixels;
+static int rasterWidth;
+static int rasterHeight;
+static int rasterColumns;
+static int rasterRows;
+static rasterBin* rasterBins;
+static rasterTriangle* rasterTriangles;
+static int rasterTriangleCount;
+static int rasterTriangleCapacity;
+static Uint32 rasterBackground;
+static rasterCopy* rasterCopies;
+static int rasterCopyCount;
+static int rasterCopyCapacity;
+
+static bool rasterResize(int width, int height) {
+    if (width == rasterWidth && height == rasterHeight && rasterPixels) {
+        return TRUE;
+    }
+
+    int columns = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    int rows = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    Uint32* pixels = memoryAlloc(MEMORY_RENDER, (size_t)width * height * sizeof(Uint32));
+    rasterBin* bins = memoryCalloc(MEMORY_RENDER, (size_t)columns * rows, sizeof(rasterBin));
+
+    if (!pixels || !bins) {
+        memoryFree(pixels);
+        memoryFree(bins);
+        return FALSE;
+    }
+
+    for (int i = 0; i < rasterColumns * rasterRows; i++) {
+        memoryFree(rasterBins[i].triangles);
+    }
+
+    memoryFree(rasterPixels);
+    memoryFree(rasterBins);
+
+    if (rasterTexture) {
+        memoryDestroyTexture(rasterTexture);
+        rasterTexture = NULL;
+    }
+
+    rasterPixels = pixels;
+    rasterBins = bins;
+    rasterWidth = width;
+    rasterHeight = height;
+    rasterColumns = columns;
+    rasterRows = rows;
+    rasterTriangleCount = 0;
+
+    return TRUE;
+}
+
+static void rasterClear(color c) {
+    int w = 0;
+    int h = 0;
+
+    SDL_GetRendererOutputSize(initializedNest->renderer, &w, &h);
+
+    if (w > 0 && h > 0) {
+        rasterResize(w, h);
+    }
+
+    for (int i = 0; i < rasterColumns * rasterRows; i++) {
+        rasterBins[i].count = 0;
+    }
+
+    for (int i = 0; i < rasterCopyCount; i++) {
+        memoryFreeSurface(rasterCopies[i].surface);
+    }
+
+    rasterCopyCount = 0;
+    rasterTriangleCount = 0;
+    rasterBackground = 0xFF000000u | ((Uint32)c.r << 16) | ((Uint32)c.g << 8) | c.b;
+}
+
+static rasterPlane rasterPlaneFor(const rasterTriangle* t, float inverseArea, float f0, float f1, float f2) {
+    rasterPlane p;
+    float d1 = f1 - f0;
+    float d2 = f2 - f0;
+
+    p.dx = (t->edges[1].dx * d1 + t->edges[2].dx * d2) * inverseArea;
+    p.dy = (t->edges[1].dy * d1 + t->edges[2].dy * d2) * inverseArea;
+    p.c = f0 + (t->edges[1].c * d1 + t->edges[2].c * d2) * inverseArea;
+
+    return p;
+}
+
+static bool rasterSetup(rasterTriangle* t, const SDL_Vertex* a, const SDL_Vertex* b, const SDL_Vertex* c, const SDL_Surface* surface) {
+    const SDL_Vertex* v[3] = { a, b, c };
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < 3; k++) {
+            const SDL_FPoint* p = &v[(k + 1) % 3]->position;
+            const SDL_FPoint* q = &v[(k + 2) % 3]->position;
+
+            t->edges[k].dx = p->y - q->y;
+            t->edges[k].dy = q->x - p->x;
+            t->edges[k].c = p->x * q->y - p->y * q->x;
+            t->topLeft[k] = t->edges[k].dx > 0 || (t->edges[k].dx == 0 && t->edges[k].dy < 0);
+        }
+
+        float area = t->edges[0].dx * v[0]->position.x + t->edges[0].dy * v[0]->position.y + t->edges[0].c;
+
+        if (area == 0) {
+            return FALSE;
+        }
+
+        if (area > 0) {
+            float minX = SDL_min(v[0]->position.x, SDL_min(v[1]->position.x, v[2]->position.x));
+            float minY = SDL_min(v[0]->position.y, SDL_min(v[1]->position.y, v[2]->position.y));
+            float maxX = SDL_max(v[0]->position.x, SDL_max(v[1]->position.x, v[2]->position.x));
+            float maxY = SDL_max(v[0]->position.y, SDL_max(v[1]->position.y, v[2]->position.y));
+
+            t->minX = SDL_max((int)floorf(minX), 0);
+            t->minY = SDL_max((int)floorf(minY), 0);
+            t->maxX = SDL_min((int)ceilf(maxX), rasterWidth - 1);
+            t->maxY = SDL_min((int)ceilf(maxY), rasterHeight - 1);
+
+            if (t->minX > t->maxX || t->minY > t->maxY) {
+                return FALSE;
+            }
+
+            const SDL_Color* c0 = &v[0]->color;
+            const SDL_Color* c1 = &v[1]->color;
+            const SDL_Color* c2 = &v[2]->color;
+            float inverseArea = 1.0f / area;
+
+            t->surface = surface;
+            t->shaded = memcmp(c0, c1, sizeof(SDL_Color)) != 0 || memcmp(c0, c2, sizeof(SDL_Color)) != 0;
+            t->flat = ((Uint32)c0->a << 24) | ((Uint32)c0->r << 16) | ((Uint32)c0->g << 8) | c0->b;
+
+            if (surface) {
+                t->u = rasterPlaneFor(t, inverseArea, v[0]->tex_coord.x * surface->w, v[1]->tex_coord.x * surface->w, v[2]->tex_coord.x * surface->w);
+                t->v = rasterPlaneFor(t, inverseArea, v[0]->tex_coord.y * surface->h, v[1]->tex_coord.y * surface->h, v[2]->tex_coord.y * surface->h);
+            }
+
+            if (t->shaded) {
+                t->channels[0] = rasterPlaneFor(t, inverseArea, c0->a, c1->a, c2->a);
+                t->channels[1] = rasterPlaneFor(t, inverseArea, c0->r, c1->r, c2->r);
+                t->channels[2] = rasterPlaneFor(t, inverseArea, c0->g, c1->g, c2->g);
+                t->channels[3] = rasterPlaneFor(t, inverseArea, c0->b, c1->b, c2->b);
+            }
+
+            return TRUE;
+        }
+
+        const SDL_Vertex* swap = v[1];
+        v[1] = v[2];
+        v[2] = swap;
+    }
+
+    return FALSE;
+}
+
+// Textures that weren't loaded through textureLoad, such as ones the game made
+// itself, carry no pixels for the rasterizer. They are read back through a
+// render target, once per frame so that changes to them show up.
+static const SDL_Surface* rasterTextureSurface(texture tex) {
+    SDL_Renderer* r = initializedNest->renderer;
+    SDL_Surface* s = SDL_GetTextureUserData(tex);
+    int w = 0;
+    int h = 0;
+
+    if (s) {
+        return s;
+    }
+
+    for (int i = 0; i < rasterCopyCount; i++) {
+        if (rasterCopies[i].tex == tex) {
+            return rasterCopies[i].surface;
+        }
+    }
+
+    if (SDL_QueryTexture(tex, NULL, NULL, &w, &h) != 0 || !SDL_RenderTargetSupported(r)) {
+        return NULL;
+    }
+
+    if (rasterCopyCount == rasterCopyCapacity) {
+        int capacity = rasterCopyCapacity ? rasterCopyCapacity * 2 : 8;
+        rasterCopy* copies = memoryRealloc(MEMORY_RENDER, rasterCopies, capacity * sizeof(rasterCopy));
+
+        if (!copies) {
+            return NULL;
+        }
+
+        rasterCopies = copies;
+        rasterCopyCapacity = capacity;
+    }
+
+    SDL_Texture* target = memoryTexture(SDL_CreateTexture(r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h));
+    s = memorySurface(SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888));
+
+    if (target && s) {
+        SDL_Texture* previous = SDL_GetRenderTarget(r);
+        SDL_BlendMode mode = SDL_BLENDMODE_BLEND;
+        Uint8 red = 255, green = 255, blue = 255, alpha = 255;
+
+        SDL_GetTextureBlendMode(tex, &mode);
+        SDL_GetTextureColorMod(tex, &red, &green, &blue);
+        SDL_GetTextureAlphaMod(tex, &alpha);
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
+        SDL_SetTextureColorMod(tex, 255, 255, 255);
+        SDL_SetTextureAlphaMod(tex, 255);
+        SDL_SetRenderTarget(r, target);
+
+        if (SDL_RenderCopy(r, tex, NULL, NULL) != 0 ||
+            SDL_RenderReadPixels(r, NULL, SDL_PIXELFORMAT_ARGB8888, s->pixels, s->pitch) != 0) {
+            memoryFreeSurface(s);
+            s = NULL;
+        }
+
+        SDL_SetRenderTarget(r, previous);
+        SDL_SetTextureBlendMode(tex, mode);
+        SDL_SetTextureColorMod(tex, red, green, blue);
+        SDL_SetTextureAlphaMod(tex, alpha);
+    }
+    else {
+        memoryFreeSurface(s);
+        s = NULL;
+    }
+
+    if (target) {
+        memoryDestroyTexture(target);
+    }
+
+    if (s) {
+        rasterCopies[rasterCopyCount].tex = tex;
+        rasterCopies[rasterCopyCount].surface = s;
+        rasterCopyCount++;
+    }
+
+    return s;
+}
+
+static void rasterGeometry(texture tex, const SDL_Vertex* vertices, const int* indices, int indexCount, blendMode blend) {
+    const SDL_Surface* surface = tex && rasterPixels ? rasterTextureSurface(tex) : NULL;
+
+    if (!rasterPixels || (tex && !surface)) {
+        return;
+    }
+
+    for (int i = 0; i + 2 < indexCount; i += 3) {
+        if (rasterTriangleCount == rasterTriangleCapacity) {
+            int capacity = rasterTriangleCapacity ? rasterTriangleCapacity * 2 : 1024;
+            rasterTriangle* triangles = memoryRealloc(MEMORY_RENDER, rasterTriangles, capacity * sizeof(rasterTriangle));
+
+            if (!triangles) {
+                return;
+            }
+
+            rasterTriangles = triangles;
+            rasterTriangleCapacity = capacity;
+        }
+
+        rasterTriangle* t = &rasterTriangles[rasterTriangleCount];
+
+        if (!rasterSetup(t, &vertices[indices[i]], &vertices[indices[i + 1]], &vertices[indices[i + 2]], surface)) {
+            continue;
+        }
+
+        t->blend = blend;
+
+        for (int ty = t->minY / RASTER_TILE_SIZE; ty <= t->maxY / RASTER_TILE_SIZE; ty++) {
+            for (int tx = t->minX / RASTER_TILE_SIZE; tx <= t->maxX / RASTER_TILE_SIZE; tx++) {
+                rasterBin* bin = &rasterBins[ty * rasterColumns + tx];
+
+                if (bin->count == bin->capacity) {
+                    int capacity = bin->capacity ? bin->capacity * 2 : 64;
+                    int* stored = memoryRealloc(MEMORY_RENDER, bin->triangles, capacity * sizeof(int));
+
+                    if (!stored) {
+                        continue;
+                    }
+
+                    bin->triangles = stored;
+                    bin->capacity = capacity;
+                }
+
+                bin->triangles[bin->count++] = rasterTriangleCount;
+            }
+        }
+
+        rasterTriangleCount++;
+    }
+}
+
+static Uint32 rasterBlend(Uint32 dst, Uint32 src) {
+    Uint32 a = src >> 24;
+
+    if (a == 255) {
+        return src;
+    }
+
+    if (a == 0) {
+        return dst;
+    }
+
+    Uint32 ia = 255 - a;
+    Uint32 rb = (((src & 0xFF00FF) * a + (dst & 0xFF00FF) * ia) >> 8) & 0xFF00FF;
+    Uint32 g = (((src & 0x00FF00) * a + (dst & 0x00FF00) * ia) >> 8) & 0x00FF00;
+
+    return 0xFF000000u | rb | g;
+}
+
+// The other modes follow SDL's: add scales the source by its alpha, multiply
+// is src * dst + dst * (1 - alpha), and none copies the source.
+static Uint32 rasterCombine(Uint32 dst, Uint32 src, blendMode mode) {
+    Uint32 a = src >> 24;
+    Uint32 result = 0xFF000000u;
+
+    if (mode == BLEND_ALPHA) {
+        return rasterBlend(dst, src);
+    }
+
+    if (mode == BLEND_NONE) {
+        return result | src;
+    }
+
+    for (int shift = 0; shift < 24; shift += 8) {
+        Uint32 s = (src >> shift) & 0xFF;
+        Uint32 d = (dst >> shift) & 0xFF;
+        Uint32 value = mode == BLEND_ADD ? d + (s * a + 127) / 255 : (s * d + d * (255 - a) + 127) / 255;
+
+        result |= SDL_min(value, 255u) << shift;
+    }
+
+    return result;
+}
+
+static Uint32 rasterModulate(Uint32 texel, Uint32 a, Uint32 r, Uint32 g, Uint32 b) {
+    return ((((texel >> 24) * a + 255) >> 8) << 24) |
+           (((((texel >> 16) & 0xFF) * r + 255) >> 8) << 16) |
+           (((((texel >> 8) & 0xFF) * g + 255) >> 8) << 8) |
+           (((texel & 0xFF) * b + 255) >> 8);
+}
+
+static void rasterFill(Uint32* row, int count, Uint32 color) {
+    Uint32 a = color >> 24;
+    int i = 0;
+
+    if (a == 0) {
+        return;
+    }
+
+#ifdef __SSE2__
+    if (a == 255) {
+        __m128i fill = _mm_set1_epi32((int)color);
+
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128((__m128i*)(row + i), fill);
+        }
+    }
+    else {
+        __m128i zero = _mm_setzero_si128();
+        __m128i opaque = _mm_set1_epi32((int)0xFF000000u);
+        __m128i inverse = _mm_set1_epi16((short)(255 - a));
+        __m128i source = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero), _mm_set1_epi16((short)a));
+
+        for (; i + 4 <= count; i += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(row + i));
+            __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse), source), 8);
+            __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse), source), 8);
+
+            _mm_storeu_si128((__m128i*)(row + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        row[i] = rasterBlend(row[i], color);
+    }
+}
+
+static bool rasterSpan(const rasterTriangle* t, float py, int left, int right, int* x0, int* x1) {
+    int start = left;
+    int end = right;
+
+    for (int k = 0; k < 3; k++) {
+        const rasterPlane* e = &t->edges[k];
+        float value = e->dy * py + e->c;
+
+        if (e->dx == 0) {
+            if (value < 0 || (value == 0 && !t->topLeft[k])) {
+                return FALSE;
+            }
+
+            continue;
+        }
+
+        float edge = -value / e->dx - 0.5f;
+
+        if (e->dx > 0) {
+            int first = t->topLeft[k] ? (int)ceilf(edge) : (int)floorf(edge) + 1;
+            start = SDL_max(start, first);
+        }
+        else {
+            int last = t->topLeft[k] ? (int)floorf(edge) : (int)ceilf(edge) - 1;
+            end = SDL_min(end, last);
+        }
+    }
+
+    *x0 = start;
+    *x1 = end;
+
+    return start <= end;
+}
+
+static void rasterShade(const rasterTriangle* t, Uint32* row, int x0, int x1, float py) {
+    float px = x0 + 0.5f;
+    float u = t->u.dx * px + t->u.dy * py + t->u.c;
+    float v = t->v.dx * px + t->v.dy * py + t->v.c;
+    float channel[4];
+    Uint32 a = t->flat >> 24;
+    Uint32 r = (t->flat >> 16) & 0xFF;
+    Uint32 g = (t->flat >> 8) & 0xFF;
+    Uint32 b = t->flat & 0xFF;
+    bool modulate = t->shaded || t->flat != 0xFFFFFFFFu;
+
+    for (int k = 0; k < 4; k++) {
+        channel[k] = t->shaded ? t->channels[k].dx * px + t->channels[k].dy * py + t->channels[k].c : 0;
+    }
+
+    for (int x = x0; x <= x1; x++) {
+        Uint32 color = 0xFFFFFFFFu;
+
+        if (t->shaded) {
+            a = (Uint32)SDL_clamp(channel[0], 0.0f, 255.0f);
+            r = (Uint32)SDL_clamp(channel[1], 0.0f, 255.0f);
+            g = (Uint32)SDL_clamp(channel[2], 0.0f, 255.0f);
+            b = (Uint32)SDL_clamp(channel[3], 0.0f, 255.0f);
+
+            for (int k = 0; k < 4; k++) {
+                channel[k] += t->channels[k].dx;
+            }
+        }
+
+        if (t->surface) {
+            int sx = SDL_clamp((int)floorf(u), 0, t->surface->w - 1);
+            int sy = SDL_clamp((int)floorf(v), 0, t->surface->h - 1);
+
+            color = *((const Uint32*)((const Uint8*)t->surface->pixels + sy * t->surface->pitch) + sx);
+            u += t->u.dx;
+            v += t->v.dx;
+        }
+
+        if (modulate) {
+            color = rasterModulate(color, a, r, g, b);
+        }
+
+        row[x] = rasterCombine(row[x], color, t->blend);
+    }
+}
+
+static void rasterTile(void* data, int index) {
+    const rasterBin* bin = &rasterBins[index];
+    int left = (index % rasterColumns) * RASTER_TILE_SIZE;
+    int top = (index / rasterColumns) * RASTER_TILE_SIZE;
+    int right = SDL_min(left + RASTER_TILE_SIZE, rasterWidth) - 1;
+    int bottom = SDL_min(top + RASTER_TILE_SIZE, rasterHeight) - 1;
+
+    (void)data;
+
+    for (int y = top; y <= bottom; y++) {
+        rasterFill(rasterPixels + (size_t)y * rasterWidth + left, right - left + 1, rasterBackground);
+    }
+
+    for (int i = 0; i < bin->count; i++) {
+        const rasterTriangle* t = &rasterTriangles[bin->triangles[i]];
+        int y0 = SDL_max(t->minY, top);
+        int y1 = SDL_min(t->maxY, bottom);
+
+        for (int y = y0; y <= y1; y++) {
+            float py = y + 0.5f;
+            int x0, x1;
+
+            if (!rasterSpan(t, py, SDL_max(t->minX, left), SDL_min(t->maxX, right), &x0, &x1)) {
+                continue;
+            }
+
+            Uint32* row = rasterPixels + (size_t)y * rasterWidth;
+
+            if (t->surface || t->shaded || t->blend != BLEND_ALPHA) {
+                rasterShade(t, row, x0, x1, py);
+            }
+            else {
+                rasterFill(row + x0, x1 - x0 + 1, t->flat);
+            }
+        }
+    }
+}
+
+static void rasterPresent(void) {
+    SDL_Renderer* renderer = initializedNest->renderer;
+
+    if (!rasterPixels) {
+        return;
+    }
+
+    jobsRun(rasterTile, NULL, rasterColumns * rasterRows);
+
+    postProcess(rasterPixels, rasterWidth, rasterHeight);
+
+    if (!rasterTexture) {
+        rasterTexture = memoryTexture(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, rasterWidth, rasterHeight));
+    }
+
+    if (rasterTexture) {
+        SDL_UpdateTexture(rasterTexture, NULL, rasterPixels, rasterWidth * sizeof(Uint32));
+        SDL_RenderCopy(renderer, rasterTexture, NULL, NULL);
+    }
+
+    for (int i = 0; i < rasterColumns * rasterRows; i++) {
+        rasterBins[i].count = 0;
+    }
+
+    rasterTriangleCount = 0;
+}
+
+static void rasterFree(void) {
+    for (int i = 0; i < rasterColumns * rasterRows; i++) {
+        memoryFree(rasterBins[i].triangles);
+    }
+
+    if (rasterTexture) {
+        memoryDestroyTexture(rasterTexture);
+    }
+
+    memoryFree(rasterBins);
+    memoryFree(rasterPixels);
+    memoryFree(rasterTriangles);
+
+    for (int i = 0; i < rasterCopyCount; i++) {
+        memoryFreeSurface(rasterCopies[i].surface);
+    }
+
+    memoryFree(rasterCopies);
+    rasterCopies = NULL;
+    rasterCopyCount = rasterCopyCapacity = 0;
+    rasterTexture = NULL;
+    rasterBins = NULL;
+    rasterPixels = NULL;
+    rasterTriangles = NULL;
+    rasterWidth = rasterHeight = 0;
+    rasterColumns = rasterRows = 0;
+    rasterTriangleCount = rasterTriangleCapacity = 0;
+}
+
+// Geometry
+
+static SDL_Vertex* geometryVertices;
+static int geometryVertexCount;
+static int geometryVertexCapacity;
+static int* geometryIndices;
+static int geometryIndexCount;
+static int geometryIndexCapacity;
+static texture geometryTexture;
+static blendMode geometryBlend;
+static blendMode drawBlend;
+
+static bool geometryReserve(int vertices, int indices) {
+    if (geometryVertexCount + vertices > geometryVertexCapacity) {
+        int capacity = geometryVertexCapacity ? geometryVertexCapacity : 1024;
+
+        while (capacity < geometryVertexCount + vertices) {
+            capacity *= 2;
+        }
+
+        SDL_Vertex* v = memoryRealloc(MEMORY_GEOMETRY, geometryVertices, capacity * sizeof(SDL_Vertex));
+
+        if (!v) {
+            return FALSE;
+        }
+
+        geometryVertices = v;
+        geometryVertexCapacity = capacity;
+    }
+
+    if (geometryIndexCount + indices > geometryIndexCapacity) {
+        int capacity = geometryIndexCapacity ? geometryIndexCapacity : 2048;
+
+        while (capacity < geometryIndexCount + indices) {
+            capacity *= 2;
+        }
+
+        int* i = memoryRealloc(MEMORY_GEOMETRY, geometryIndices, capacity * sizeof(int));
+
+        if (!i) {
+            return FALSE;
+        }
+
+        geometryIndices = i;
+        geometryIndexCapacity = capacity;
+    }
+
+    return TRUE;
+}
+
+static SDL_BlendMode geometryBlendSDL(blendMode mode) {
+    switch (mode) {
+        case BLEND_ADD:
+            return SDL_BLENDMODE_ADD;
+        case BLEND_MULTIPLY:
+            return SDL_BLENDMODE_MUL;
+        case BLEND_NONE:
+            return SDL_BLENDMODE_NONE;
+        default:
+            return SDL_BLENDMODE_BLEND;
+    }
+}
+
+// Untextured geometry blends by the renderer's draw mode and textured geometry
+// by the texture's, so whichever one this batch uses is set on every submit.
+static void geometrySubmit(texture t, const SDL_Vertex* vertices, int vertexCount, const int* indices, int indexCount) {
+    if (rasterMode) {
+        rasterGeometry(t, vertices, indices, indexCount, geometryBlend);
+    }
+    else {
+        if (t) {
+            SDL_SetTextureBlendMode(t, geometryBlendSDL(geometryBlend));
+        }
+        else {
+            SDL_SetRenderDrawBlendMode(initializedNest->renderer, geometryBlendSDL(geometryBlend));
+        }
+
+        SDL_RenderGeometry(initializedNest->renderer, t, vertices, vertexCount, indices, indexCount);
+    }
+}
+
+static void geometryFlush(void) {
+    if (geometryIndexCount > 0) {
+        geometrySubmit(geometryTexture,
+                       geometryVertices,
+                       geometryVertexCount,
+                       geometryIndices,
+                       geometryIndexCount);
+    }
+
+    geometryVertexCount = 0;
+    geometryIndexCount = 0;
+}
+
+static bool geometryBegin(texture t, int vertices, int indices) {
+    if (t != geometryTexture) {
+        geometryFlush();
+        geometryTexture = t;
+    }
+
+    return geometryReserve(vertices, indices);
+}
+
+static int geometryVertexUV(float x, float y, SDL_Color c, float u, float v) {
+    SDL_Vertex* vertex = &geometryVertices[geometryVertexCount];
+
+    vertex->position.x = x;
+    vertex->position.y = y;
+    vertex->color = c;
+    vertex->tex_coord.x = u;
+    vertex->tex_coord.y = v;
+
+    return geometryVertexCount++;
+}
+
+static int geometryVertex(float x, float y, SDL_Color c) {
+    return geometryVertexUV(x, y, c, 0.0f, 0.0f);
+}
+
+static void geometryTriangle(int a, int b, int c) {
+    geometryIndices[geometryIndexCount++] = a;
+    geometryIndices[geometryIndexCount++] = b;
+    geometryIndices[geometryIndexCount++] = c;
+}
+
+static void geometryQuad(int a, int b, int c, int d) {
+    geometryTriangle(a, b, c);
+    geometryTriangle(a, c, d);
+}
+
+static void geometryFree(void) {
+    memoryFree(geometryVertices);
+    memoryFree(geometryIndices);
+    geometryVertices = NULL;
+    geometryIndices = NULL;
+    geometryVertexCount = geometryVertexCapacity = 0;
+    geometryIndexCount = geometryIndexCapacity = 0;
+    geometryTexture = NULL;
+    geometryBlend = drawBlend = BLEND_ALPHA;
+}
+
+// Sprites and text wait in their own queues before reaching the geometry batch,
+// so those are drained under the old mode before the new one takes over.
+static void renderBlend(blendMode mode) {
+    if (mode != geometryBlend) {
+        spriteBatchFlush();
+        geometryFlush();
+        textBatchFlush();
+        geometryBlend = mode;
+    }
+}
+
+static bool commandBlend(blendMode mode);
+
+void setBlendMode(blendMode mode) {
+    if (mode < BLEND_ALPHA || mode > BLEND_NONE || mode == drawBlend) {
+        return;
+    }
+
+    drawBlend = mode;
+
+    if (!commandBlend(mode)) {
+        renderBlend(mode);
+    }
+}
+
+blendMode getBlendMode(void) {
+    return drawBlend;
+}
+
+// Primitives
+
+primitive newRectangle(vector2 position, float width, float height, color color) {
+    entity e = entityInit(rand(), vectorZero());
+    primitive p;
+    p.base = e;
+    p.type = RECTANGLE;
+    p.color = color;
+    p.filled = FALSE;
+    p.base.position = position;
+    p.rectangle.width = width;
+    p.rectangle.height = height;
+    return p;
+}
+
+primitive newCircle(vector2 position, float radius, int segments, color color) {
+    entity e = entityInit(rand(), vectorZero());
+    primitive p;
+    p.base = e;
+    p.type = CIRCLE;
+    p.color = color;
+    p.filled = FALSE;
+    p.base.position = position;
+    p.circle.radius = radius;
+    p.circle.segments = segments;
+    return p;
+}
+
+primitive newTriangle(vector2 position, float base, float height, float skew, color color) {
+    entity e = entityInit(rand(), vectorZero());
+    primitive p;
+    p.base = e;
+    p.type = TRIANGLE;
+    p.color = color;
+    p.filled = FALSE;
+    p.base.position = position;
+    p.triangle.base = base;
+    p.triangle.height = height;
+    p.triangle.skew = skew;
+    return p;
+}
+
+primitive newLine(vector2 pointA, vector2 pointB, float width, color color) {
+    entity e = entityInit(rand(), vectorZero());
+    primitive p;
+    p.base = e;
+    p.type = LINE;
+    p.color = color;
+    p.filled = FALSE;
+    p.base.position = pointA;
+    p.line.endPoint = pointB;
+    p.line.width = width;
+    p.line.cap = CAP_BUTT;
+    return p;
+}
+
+// Strokes
+
+#define STROKE_MITER_LIMIT 4.0f
+
+static void strokeArc(vector2 center, float radius, float start, float sweep, SDL_Color c) {
+    float step = radius > 0.25f ? 2.0f * acosf(1.0f - 0.25f / radius) : (float)M_PI;
+    int segments = SDL_clamp((int)ceilf(fabsf(sweep) / step), 1, 64);
+
+    if (!geometryReserve(segments + 2, segments * 3)) {
+        return;
+    }
+
+    int first = geometryVertex(center.x, center.y, c);
+
+    for (int i = 0; i <= segments; i++) {
+        float a = start + sweep * i / segments;
+        geometryVertex(center.x + radius * cosf(a), center.y + radius * sinf(a), c);
+
+        if (i > 0) {
+            geometryTriangle(first, first + i, first + i + 1);
+        }
+    }
+}
+
+static void strokeQuad(vector2 a, vector2 b, vector2 n, SDL_Color c) {
+    if (!geometryReserve(4, 6)) {
+        return;
+    }
+
+    int i0 = geometryVertex(a.x + n.x, a.y + n.y, c);
+    int i1 = geometryVertex(b.x + n.x, b.y + n.y, c);
+    int i2 = geometryVertex(b.x - n.x, b.y - n.y, c);
+    int i3 = geometryVertex(a.x - n.x, a.y - n.y, c);
+    geometryQuad(i0, i1, i2, i3);
+}
+
+static void strokeCap(vector2 p, vector2 d, float half, lineCap cap, SDL_Color c) {
+    vector2 n = { -d.y * half, d.x * half };
+
+    if (cap == CAP_SQUARE) {
+        strokeQuad(p, (vector2){ p.x + d.x * half, p.y + d.y * half }, n, c);
+    }
+    else if (cap == CAP_ROUND) {
+        strokeArc(p, half, atan2f(n.y, n.x), -(float)M_PI, c);
+    }
+}
+
+static void strokeJoin(vector2 p, vector2 d0, vector2 d1, float half, lineJoin join, SDL_Color c) {
+    float cross = d0.x * d1.y - d0.y * d1.x;
+    float dot = d0.x * d1.x + d0.y * d1.y;
+
+    if (fabsf(cross) < 1e-6f && dot > 0) {
+        return;
+    }
+
+    float side = cross > 0 ? -half : half;
+    vector2 o0 = { -d0.y * side, d0.x * side };
+    vector2 o1 = { -d1.y * side, d1.x * side };
+
+    if (join == JOIN_ROUND) {
+        strokeArc(p, half, atan2f(o0.y, o0.x), atan2f(o0.x * o1.y - o0.y * o1.x, o0.x * o1.x + o0.y * o1.y), c);
+        return;
+    }
+
+    if (!geometryReserve(4, 6)) {
+        return;
+    }
+
+    int center = geometryVertex(p.x, p.y, c);
+    int a = geometryVertex(p.x + o0.x, p.y + o0.y, c);
+    int b = geometryVertex(p.x + o1.x, p.y + o1.y, c);
+
+    if (join == JOIN_MITER) {
+        float mx = o0.x + o1.x;
+        float my = o0.y + o1.y;
+        float length = sqrtf(mx * mx + my * my);
+        float cosHalf = length > 0 ? (mx * o0.x + my * o0.y) / (length * half) : 0;
+
+        if (cosHalf > 1.0f / STROKE_MITER_LIMIT) {
+            float scale = half / (cosHalf * length);
+            int m = geometryVertex(p.x + mx * scale, p.y + my * scale, c);
+            geometryTriangle(center, a, m);
+            geometryTriangle(center, m, b);
+            return;
+        }
+    }
+
+    geometryTriangle(center, a, b);
+}
+
+static void strokePolyline(const vector2* points, int count, float half, lineJoin join, lineCap cap, SDL_Color c) {
+    vector2 previous = { 0, 0 };
+    vector2 end = { 0, 0 };
+    bool started = FALSE;
+
+    for (int i = 0; i + 1 < count; i++) {
+        vector2 a = points[i];
+        vector2 b = points[i + 1];
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float length = sqrtf(dx * dx + dy * dy);
+
+        if (length <= 1e-6f) {
+            continue;
+        }
+
+        vector2 d = { dx / length, dy / length };
+
+        if (started) {
+            strokeJoin(a, previous, d, half, join, c);
+        }
+        else {
+            strokeCap(a, (vector2){ -d.x, -d.y }, half, cap, c);
+            started = TRUE;
+        }
+
+        strokeQuad(a, b, (vector2){ -d.y * half, d.x * half }, c);
+        previous = d;
+        end = b;
+    }
+
+    if (started) {
+        strokeCap(end, previous, half, cap, c);
+    }
+}
+
+static void renderPolyline(const vector2* points, int count, float width, lineJoin join, lineCap cap, color color) {
+    if (!geometryBegin(NULL, 0, 0)) {
+        return;
+    }
+
+    SDL_Color c = colorSDL(color);
+    strokePolyline(points, count, SDL_max(width, 1.0f) / 2, join, cap, c);
+}
+
+static void fillPrimitive(primitive* p) {
+    SDL_Color c = colorSDL(p->color);
+    float x = p->base.position.x;
+    float y = p->base.position.y;
+
+    switch (p->type) {
+        case RECTANGLE: {
+            if (!geometryBegin(NULL, 4, 6)) {
+                return;
+            }
+
+            int a = geometryVertex(x, y, c);
+            int b = geometryVertex(x + p->rectangle.width, y, c);
+            int d = geometryVertex(x + p->rectangle.width, y + p->rectangle.height, c);
+            int e = geometryVertex(x, y + p->rectangle.height, c);
+            geometryQuad(a, b, d, e);
+            break;
+        }
+
+        case CIRCLE: {
+            int segments = SDL_max(p->circle.segments, 3);
+
+            if (!geometryBegin(NULL, segments + 1, segments * 3)) {
+                return;
+            }
+
+            int center = geometryVertex(x, y, c);
+            float step = 2.0f * (float)M_PI / segments;
+
+            for (int i = 0; i < segments; i++) {
+                geometryVertex(x + p->circle.radius * cosf(step * i), y + p->circle.radius * sinf(step * i), c);
+                geometryTriangle(center, center + 1 + i, center + 1 + (i + 1) % segments);
+            }
+            break;
+        }
+
+        case TRIANGLE: {
+            if (!geometryBegin(NULL, 3, 3)) {
+                return;
+            }
+
+            int a = geometryVertex(x, y, c);
+            int b = geometryVertex(x + p->triangle.base, y, c);
+            int d = geometryVertex(x + p->triangle.base / 2 + p->triangle.skew, y - p->triangle.height, c);
+            geometryTriangle(a, b, d);
+            break;
+        }
+
+        case LINE: {
+            vector2 points[2] = { p->base.position, p->line.endPoint };
+
+            if (!geometryBegin(NULL, 0, 0)) {
+                return;
+            }
+
+            strokePolyline(points, 2, SDL_max(p->line.width, 1.0f) / 2, JOIN_MITER, p->line.cap, c);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void outlinePrimitive(primitive* p) {
+    vector2 points[130];
+    vector2 position = p->base.position;
+    int count = 0;
+
+    switch (p->type) {
+        case RECTANGLE:
+            points[0] = position;
+            points[1] = (vector2){ position.x + p->rectangle.width, position.y };
+            points[2] = (vector2){ position.x + p->rectangle.width, position.y + p->rectangle.height };
+            points[3] = (vector2){ position.x, position.y + p->rectangle.height };
+            points[4] = position;
+            count = 5;
+            break;
+
+        case CIRCLE: {
+            int segments = SDL_clamp(p->circle.segments, 3, 128);
+            float step = 2.0f * (float)M_PI / segments;
+
+            for (int i = 0; i <= segments; i++) {
+                points[i] = (vector2){ position.x + p->circle.radius * cosf(step * (i % segments)),
+                                       position.y + p->circle.radius * sinf(step * (i % segments)) };
+            }
+
+            count = segments + 1;
+            break;
+        }
+
+        case TRIANGLE:
+            points[0] = position;
+            points[1] = (vector2){ position.x + p->triangle.base, position.y };
+            points[2] = (vector2){ position.x + p->triangle.base / 2 + p->triangle.skew, position.y - p->triangle.height };
+            points[3] = position;
+            count = 4;
+            break;
+
+        case LINE:
+            points[0] = position;
+            points[1] = p->line.endPoint;
+            count = 2;
+            break;
+
+        default:
+            break;
+    }
+
+    renderPolyline(points, count, 1.0f, JOIN_MITER, p->type == LINE ? p->line.cap : CAP_BUTT, p->color);
+}
+
+static void renderPrimitive(primitive* p) {
+    if (p->filled || (p->type == LINE && p->line.width > 1.0f)) {
+        fillPrimitive(p);
+        return;
+    }
+
+    if (rasterMode) {
+        outlinePrimitive(p);
+        return;
+    }
+
+    geometryFlush();
+    SDL_SetRenderDrawBlendMode(initializedNest->renderer, geometryBlendSDL(geometryBlend));
+
+    switch (p->type) {
+        case RECTANGLE: {
+            SDL_Rect rect = {
+                (int)p->base.position.x, 
+                (int)p->base.position.y,
+                (int)p->rectangle.width,
+                (int)p->rectangle.height
+            };
+            SDL_SetRenderDrawColor(initializedNest->renderer,
+                                   p->color.r,
+                                   p->color.g,
+                                   p->color.b,
+                                   p->color.a);
+            SDL_RenderDrawRect(initializedNest->renderer, &rect);
+            break;
+        }
+        
+        case CIRCLE: {
+            int cx = (int)p->base.position.x;
+            int cy = (int)p->base.position.y;
+            int radius = (int)p->circle.radius;
+            
+            SDL_SetRenderDrawColor(initializedNest->renderer,
+                                   p->color.r,
+                                   p->color.g,
+                                   p->color.b,
+                                   p->color.a);
+            
+            for (int i = 0; i < p->circle.segments; i++) {
+                float angle1 = 2.0f * 3.14159f * i / p->circle.segments;
+                float angle2 = 2.0f * 3.14159f * (i + 1) / p->circle.segments;
+                
+                int x1 = (int)(cx + radius * cos(angle1));
+                int y1 = (int)(cy + radius * sin(angle1));
+                int x2 = (int)(cx + radius * cos(angle2));
+                int y2 = (int)(cy + radius * sin(angle2));
+                
+                SDL_RenderDrawLine(initializedNest->renderer, x1, y1, x2, y2);
+            }
+            break;
+        }
+        
+        case TRIANGLE: {
+            SDL_Point points[3] = {
+                { (int)p->base.position.x, (int)p->base.position.y },
+                { (int)(p->base.position.x + p->triangle.base), (int)p->base.position.y },
+                { (int)(p->base.position.x + p->triangle.base / 2 + p->triangle.skew), (int)(p->base.position.y - p->triangle.height) }
+            };
+            
+            SDL_SetRenderDrawColor(initializedNest->renderer,
+                                   p->color.r,
+                                   p->color.g,
+                                   p->color.b,
+                                   p->color.a);
+            
+            SDL_RenderDrawLines(initializedNest->renderer, points, 3);
+            SDL_RenderDrawLine(initializedNest->renderer, points[2].x, points[2].y, points[0].x, points[0].y);
+            break;
+        }
+        
+        case LINE: {
+            SDL_SetRenderDrawColor(initializedNest->renderer,
+                                   p->color.r,
+                                   p->color.g,
+                                   p->color.b,
+                                   p->color.a);
+            SDL_RenderDrawLine(initializedNest->renderer,
+                               (int)p->base.position.x,
+                               (int)p->base.position.y,
+                               (int)p->line.endPoint.x,
+                               (int)p->line.endPoint.y);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static bool commandPrimitive(primitive* p);
+static bool commandPolyline(vector2* points, int count, float width, lineJoin join, lineCap cap, color color);
+
+void drawPrimitive(primitive* p) {
+    if (p && !commandPrimitive(p)) {
+        renderPrimitive(p);
+    }
+}
+
+void drawPolyline(vector2* points, int count, float width, lineJoin join, lineCap cap, color color) {
+    if (points && count >= 2 && !commandPolyline(points, count, width, join, cap, color)) {
+        renderPolyline(points, count, width, join, cap, color);
+    }
+}
+
+// Packs
+
+#define PACK_MAGIC 0x4B41504E
+#define PACK_VERSION 2
+
+typedef struct packEntry {
+    Uint64 hash;
+    Uint64 offset;
+    Uint64 size;
+    Uint32 nameOffset;
+    Uint32 nameSize;
+} packEntry;
+
+struct pack {
+    const Uint8* base;
+    size_t size;
+    const packEntry* entries;
+    Uint32 count;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    pack* next;
+};
+
+static pack* packs;
+
+static Uint64 packHash(const char* name) {
+    Uint64 hash = 14695981039346656037ull;
+
+    while (name[0] == '.' && (name[1] == '/' || name[1] == '\\')) {
+        name += 2;
+    }
+
+    for (; *name; name++) {
+        hash = (hash ^ (Uint8)(*name == '\\' ? '/' : *name)) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static bool packNameMatch(const char* stored, Uint32 size, const char* name) {
+    while (name[0] == '.' && (name[1] == '/' || name[1] == '\\')) {
+        name += 2;
+    }
+
+    for (Uint32 i = 0; i < size; i++, name++) {
+        if (!*name || (*name == '\\' ? '/' : *name) != stored[i]) {
+            return FALSE;
+        }
+    }
+
+    return *name == 0;
+}
+
+static const void* packMap(pack* p, const char* path) {
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    p->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+
+    if (p->file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    if (!GetFileSizeEx(p->file, &size) || size.QuadPart == 0) {
+        CloseHandle(p->file);
+        return NULL;
+    }
+
+    p->size = (size_t)size.QuadPart;
+    p->mapping = CreateFileMappingA(p->file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!p->mapping) {
+        CloseHandle(p->file);
+        return NULL;
+    }
+
+    const void* base = MapViewOfFile(p->mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!base) {
+        CloseHandle(p->mapping);
+        CloseHandle(p->file);
+    }
+
+    return base;
+#else
+    struct stat info;
+    int file = open(path, O_RDONLY);
+
+    if (file < 0) {
+        return NULL;
+    }
+
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return NULL;
+    }
+
+    p->size = (size_t)info.st_size;
+
+    void* base = mmap(NULL, p->size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    return base == MAP_FAILED ? NULL : base;
+#endif
+}
+
+static void packUnmap(pack* p) {
+#ifdef _WIN32
+    UnmapViewOfFile(p->base);
+    CloseHandle(p->mapping);
+    CloseHandle(p->file);
+#else
+    munmap((void*)p->base, p->size);
+#endif
+}
+
+pack* packMount(const char* path) {
+    pack* p = memoryCalloc(MEMORY_ASSETS, 1, sizeof(pack));
+
+    if (!p) {
+        return NULL;
+    }
+
+    p->base = packMap(p, path);
+
+    if (!p->base) {
+        memoryFree(p);
+        return NULL;
+    }
+
+    Uint32 header[4] = { 0, 0, 0, 0 };
+
+    if (p->size >= sizeof(header)) {
+        memcpy(header, p->base, sizeof(header));
+    }
+
+    p->count = SDL_SwapLE32(header[2]);
+    p->entries = (const packEntry*)(p->base + sizeof(header));
+
+    bool valid = SDL_SwapLE32(header[0]) == PACK_MAGIC && SDL_SwapLE32(header[1]) == PACK_VERSION &&
+                 p->count <= (p->size - sizeof(header)) / sizeof(packEntry);
+
+    for (Uint32 i = 0; valid && i < p->count; i++) {
+        Uint64 offset = SDL_SwapLE64(p->entries[i].offset);
+        Uint64 size = SDL_SwapLE64(p->entries[i].size);
+        Uint64 nameOffset = SDL_SwapLE32(p->entries[i].nameOffset);
+        Uint64 nameSize = SDL_SwapLE32(p->entries[i].nameSize);
+
+        valid = offset <= p->size && size <= p->size - offset && nameOffset <= p->size && nameSize <= p->size - nameOffset &&
+                (i == 0 || SDL_SwapLE64(p->entries[i - 1].hash) < SDL_SwapLE64(p->entries[i].hash));
+    }
+
+    if (!valid) {
+        packUnmap(p);
+        memoryFree(p);
+        return NULL;
+    }
+
+    p->next = packs;
+    packs = p;
+
+    return p;
+}
+
+void packUnmount(pack* p) {
+    for (pack** link = &packs; *link; link = &(*link)->next) {
+        if (*link == p) {
+            *link = p->next;
+            packUnmap(p);
+            memoryFree(p);
+            return;
+        }
+    }
+}
+
+const void* packFind(const char* name, size_t* size) {
+    Uint64 hash = packHash(name);
+
+    for (pack* p = packs; p; p = p->next) {
+        Uint32 low = 0;
+        Uint32 high = p->count;
+
+        while (low < high) {
+            Uint32 middle = low + (high - low) / 2;
+            Uint64 key = SDL_SwapLE64(p->entries[middle].hash);
+
+            if (key < hash) {
+                low = middle + 1;
+            }
+            else if (key > hash) {
+                high = middle;
+            }
+            else {
+                const packEntry* entry = &p->entries[middle];
+
+                if (!packNameMatch((const char*)p->base + SDL_SwapLE32(entry->nameOffset), SDL_SwapLE32(entry->nameSize), name)) {
+                    break;
+                }
+
+                if (size) {
+                    *size = (size_t)SDL_SwapLE64(entry->size);
+                }
+
+                return p->base + SDL_SwapLE64(entry->offset);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void packsFree(void) {
+    while (packs) {
+        packUnmount(packs);
+    }
+}
+
+// Images
+
+#define IMAGE_QOI_HEADER 14
+#define IMAGE_QOI_PADDING 8
+#define IMAGE_RAW_VERSION 1
+#define IMAGE_RAW_HEADER 32
+
+static Uint32 imageBigEndian(const Uint8* p) {
+    return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | p[3];
+}
+
+static SDL_Surface* imageDecodeQOI(const Uint8* data, size_t size) {
+    Uint32 width = imageBigEndian(data + 4);
+    Uint32 height = imageBigEndian(data + 8);
+
+    if (width == 0 || height == 0 || width > 65536 || height > 65536 ||
+        (Uint64)width * height > (Uint64)(size - IMAGE_QOI_HEADER) * 62) {
+        return NULL;
+    }
+
+    SDL_Surface* s = memorySurface(SDL_CreateRGBSurfaceWithFormat(0, (int)width, (int)height, 32, SDL_PIXELFORMAT_ARGB8888));
+
+    if (!s) {
+        return NULL;
+    }
+
+    Uint8 index[64][4];
+    Uint8 px[4] = { 0, 0, 0, 255 };
+    size_t at = IMAGE_QOI_HEADER;
+    size_t end = size - IMAGE_QOI_PADDING;
+    int run = 0;
+    bool valid = TRUE;
+
+    SDL_zeroa(index);
+
+    for (Uint32 y = 0; valid && y < height; y++) {
+        Uint32* row = (Uint32*)((Uint8*)s->pixels + y * s->pitch);
+
+        for (Uint32 x = 0; valid && x < width; x++) {
+            if (run > 0) {
+                run--;
+            }
+            else if (at < end) {
+                Uint8 op = data[at++];
+
+                if (op == 0xFE) {
+                    valid = at + 3 <= end;
+
+                    if (valid) {
+                        px[0] = data[at];
+                        px[1] = data[at + 1];
+                        px[2] = data[at + 2];
+                        at += 3;
+                    }
+                }
+                else if (op == 0xFF) {
+                    valid = at + 4 <= end;
+
+                    if (valid) {
+                        memcpy(px, data + at, 4);
+                        at += 4;
+                    }
+                }
+                else if ((op & 0xC0) == 0x00) {
+                    memcpy(px, index[op], 4);
+                }
+                else if ((op & 0xC0) == 0x40) {
+                    px[0] += ((op >> 4) & 3) - 2;
+                    px[1] += ((op >> 2) & 3) - 2;
+                    px[2] += (op & 3) - 2;
+                }
+                else if ((op & 0xC0) == 0x80) {
+                    valid = at < end;
+
+                    if (valid) {
+                        int dg = (op & 0x3F) - 32;
+                        Uint8 next = data[at++];
+
+                        px[0] += dg - 8 + (next >> 4);
+                        px[1] += dg;
+                        px[2] += dg - 8 + (next & 0x0F);
+                    }
+                }
+                else {
+                    run = op & 0x3F;
+                }
+
+                memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63], px, 4);
+            }
+            else {
+                valid = FALSE;
+            }
+
+            row[x] = ((Uint32)px[3] << 24) | ((Uint32)px[0] << 16) | ((Uint32)px[1] << 8) | px[2];
+        }
+    }
+
+    if (!valid) {
+        memoryFreeSurface(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+static SDL_Surface* imageWrapRaw(const Uint8* data, size_t size) {
+    Uint32 header[IMAGE_RAW_HEADER / 4];
+
+    memcpy(header, data, sizeof(header));
+
+    Uint32 version = SDL_SwapLE32(header[1]);
+    Uint32 width = SDL_SwapLE32(header[2]);
+    Uint32 height = SDL_SwapLE32(header[3]);
+    Uint32 format = SDL_SwapLE32(header[4]);
+    Uint32 pitch = SDL_SwapLE32(header[5]);
+
+    if (version != IMAGE_RAW_VERSION || width == 0 || height == 0 || width > 65536 || height > 65536 ||
+        SDL_ISPIXELFORMAT_FOURCC(format) || SDL_BITSPERPIXEL(format) != 32 || pitch < width * 4 ||
+        (Uint64)pitch * height > size - IMAGE_RAW_HEADER) {
+        return NULL;
+    }
+
+    return memorySurface(SDL_CreateRGBSurfaceWithFormatFrom((void*)(data + IMAGE_RAW_HEADER), (int)width, (int)height, 32, (int)pitch, format));
+}
+
+// SDL_image can't tell some formats, TGA among them, from their first bytes,
+// so the file extension goes along as a type hint.
+static const char* imageExtension(const char* path) {
+    const char* dot = SDL_strrchr(path, '.');
+
+    if (!dot || SDL_strchr(dot, '/') || SDL_strchr(dot, '\\')) {
+        return NULL;
+    }
+
+    return dot + 1;
+}
+
+static SDL_Surface* imageLoad(const char* path, void** buffer) {
+    size_t size = 0;
+    const Uint8* data = packFind(path, &size);
+
+    *buffer = NULL;
+
+    if (!data) {
+        data = *buffer = SDL_LoadFile(path, &size);
+
+        if (!data) {
+            return NULL;
+        }
+    }
+
+    if (size >= IMAGE_QOI_HEADER + IMAGE_QOI_PADDING && memcmp(data, "qoif", 4) == 0) {
+        return imageDecodeQOI(data, size);
+    }
+
+    if (size >= IMAGE_RAW_HEADER && memcmp(data, "NRAW", 4) == 0) {
+        return imageWrapRaw(data, size);
+    }
+
+    if (size > SDL_MAX_SINT32) {
+        return NULL;
+    }
+
+    return memorySurface(IMG_LoadTyped_RW(SDL_RWFromConstMem(data, (int)size), 1, imageExtension(path)));
+}
+
+// Textures
+
+typedef struct textureInfo {
+    texture tex;
+    Uint32 id;
+    int width;
+    int height;
+    bool owned;
+} textureInfo;
+
+static textureInfo* textureInfos;
+static int textureInfoCount;
+static int textureInfoCapacity;
+static Uint32 textureNextId = 1;
+
+static int textureSlot(texture t, int capacity) {
+    return (int)((((uintptr_t)t >> 4) * 2654435761u) & (capacity - 1));
+}
+
+static bool textureInfoGrow(void) {
+    int capacity = textureInfoCapacity ? textureInfoCapacity * 2 : 64;
+    textureInfo* infos = memoryCalloc(MEMORY_TEXTURES, capacity, sizeof(textureInfo));
+
+    if (!infos) {
+        return FALSE;
+    }
+
+    for (int i = 0; i < textureInfoCapacity; i++) {
+        if (textureInfos[i].tex) {
+            int slot = textureSlot(textureInfos[i].tex, capacity);
+
+            while (infos[slot].tex) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            infos[slot] = textureInfos[i];
+        }
+    }
+
+    memoryFree(textureInfos);
+    textureInfos = infos;
+    textureInfoCapacity = capacity;
+
+    return TRUE;
+}
+
+static textureInfo* textureInfoGet(texture t) {
+    static textureInfo fallback;
+
+    if (!t) {
+        return NULL;
+    }
+
+    if (textureInfoCapacity) {
+        int slot = textureSlot(t, textureInfoCapacity);
+
+        while (textureInfos[slot].tex) {
+            if (textureInfos[slot].tex == t) {
+                return &textureInfos[slot];
+            }
+
+            slot = (slot + 1) & (textureInfoCapacity - 1);
+        }
+    }
+
+    if ((textureInfoCount + 1) * 4 > textureInfoCapacity * 3 && !textureInfoGrow()) {
+        fallback.tex = t;
+        fallback.id = 0;
+        fallback.owned = FALSE;
+        SDL_QueryTexture(t, NULL, NULL, &fallback.width, &fallback.height);
+        return &fallback;
+    }
+
+    int slot = textureSlot(t, textureInfoCapacity);
+
+    while (textureInfos[slot].tex) {
+        slot = (slot + 1) & (textureInfoCapacity - 1);
+    }
+
+    textureInfo* info = &textureInfos[slot];
+    info->tex = t;
+    info->id = textureNextId++ & 0xFFFFFF;
+    SDL_QueryTexture(t, NULL, NULL, &info->width, &info->height);
+    textureInfoCount++;
+
+    return info;
+}
+
+// Returns whether the engine created the texture, and so owns its user data.
+static bool textureInfoForget(texture t) {
+    if (!t || !textureInfoCapacity) {
+        return FALSE;
+    }
+
+    int mask = textureInfoCapacity - 1;
+    int slot = textureSlot(t, textureInfoCapacity);
+
+    while (textureInfos[slot].tex != t) {
+        if (!textureInfos[slot].tex) {
+            return FALSE;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    bool owned = textureInfos[slot].owned;
+    int hole = slot;
+
+    for (int next = (hole + 1) & mask; textureInfos[next].tex; next = (next + 1) & mask) {
+        int home = textureSlot(textureInfos[next].tex, textureInfoCapacity);
+
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            textureInfos[hole] = textureInfos[next];
+            hole = next;
+        }
+    }
+
+    SDL_zero(textureInfos[hole]);
+    textureInfoCount--;
+
+    return owned;
+}
+
+static void textureInfoFree(void) {
+    memoryFree(textureInfos);
+    textureInfos = NULL;
+    textureInfoCount = 0;
+    textureInfoCapacity = 0;
+}
+
+static textureScaling textureScalingDefault;
+
+void setTextureScaling(const textureScaling* scaling) {
+    if (scaling) {
+        textureScalingDefault = *scaling;
+    }
+    else {
+        SDL_zero(textureScalingDefault);
+    }
+}
+
+static float textureScaleFactor(const textureScaling* scaling, int width, int height) {
+    float factor = 1.0f;
+
+    if (scaling->referenceWidth > 0 && scaling->referenceHeight > 0 && initializedNest) {
+        int w = 0;
+        int h = 0;
+
+        SDL_GetWindowSizeInPixels(initializedNest->window, &w, &h);
+
+        if (w > 0 && h > 0) {
+            factor = SDL_min((float)w / scaling->referenceWidth, (float)h / scaling->referenceHeight);
+        }
+    }
+
+    int largest = SDL_max(width, height);
+
+    if (scaling->maxDimension > 0 && largest * factor > scaling->maxDimension) {
+        factor = (float)scaling->maxDimension / largest;
+    }
+
+    return SDL_min(factor, 1.0f);
+}
+
+static void textureAccumulate(const SDL_Surface* s, int x, int y, float weight, float* sum) {
+    const Uint8* p = (const Uint8*)s->pixels + y * s->pitch + x * 4;
+    float alpha = p[3] * weight;
+
+    sum[0] += p[0] * alpha;
+    sum[1] += p[1] * alpha;
+    sum[2] += p[2] * alpha;
+    sum[3] += alpha;
+}
+
+static SDL_Surface* textureDownsample(SDL_Surface* source, int width, int height, textureFilter filter) {
+    SDL_Surface* src = memorySurface(SDL_ConvertSurfaceFormat(source, SDL_PIXELFORMAT_RGBA32, 0));
+    SDL_Surface* dst = src ? memorySurface(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32)) : NULL;
+
+    if (!dst) {
+        memoryFreeSurface(src);
+        return NULL;
+    }
+
+    float sx = (float)src->w / width;
+    float sy = (float)src->h / height;
+
+    for (int y = 0; y < height; y++) {
+        Uint8* out = (Uint8*)dst->pixels + y * dst->pitch;
+
+        for (int x = 0; x < width; x++, out += 4) {
+            float sum[4] = { 0, 0, 0, 0 };
+            float total;
+
+            if (filter == FILTER_BILINEAR) {
+                float fx = SDL_max((x + 0.5f) * sx - 0.5f, 0.0f);
+                float fy = SDL_max((y + 0.5f) * sy - 0.5f, 0.0f);
+                int x0 = SDL_min((int)fx, src->w - 1);
+                int y0 = SDL_min((int)fy, src->h - 1);
+                int x1 = SDL_min(x0 + 1, src->w - 1);
+                int y1 = SDL_min(y0 + 1, src->h - 1);
+                float tx = fx - x0;
+                float ty = fy - y0;
+
+                textureAccumulate(src, x0, y0, (1 - tx) * (1 - ty), sum);
+                textureAccumulate(src, x1, y0, tx * (1 - ty), sum);
+                textureAccumulate(src, x0, y1, (1 - tx) * ty, sum);
+                textureAccumulate(src, x1, y1, tx * ty, sum);
+                total = 1.0f;
+            }
+            else {
+                int x0 = (int)(x * sx);
+                int y0 = (int)(y * sy);
+                int x1 = SDL_clamp((int)ceilf((x + 1) * sx), x0 + 1, src->w);
+                int y1 = SDL_clamp((int)ceilf((y + 1) * sy), y0 + 1, src->h);
+
+                for (int v = y0; v < y1; v++) {
+                    for (int u = x0; u < x1; u++) {
+                        textureAccumulate(src, u, v, 1.0f, sum);
+                    }
+                }
+
+                total = (float)((x1 - x0) * (y1 - y0));
+            }
+
+            if (sum[3] > 0) {
+                out[0] = (Uint8)SDL_min(sum[0] / sum[3] + 0.5f, 255.0f);
+                out[1] = (Uint8)SDL_min(sum[1] / sum[3] + 0.5f, 255.0f);
+                out[2] = (Uint8)SDL_min(sum[2] / sum[3] + 0.5f, 255.0f);
+            }
+            else {
+                out[0] = out[1] = out[2] = 0;
+            }
+
+            out[3] = (Uint8)SDL_min(sum[3] / total + 0.5f, 255.0f);
+        }
+    }
+
+    memoryFreeSurface(src);
+
+    return dst;
+}
+
+typedef struct textureUpload {
+    SDL_Surface* surface;
+    SDL_Surface* pixels;
+    SDL_Texture* texture;
+    bool filtered;
+} textureUpload;
+
+static void textureUploadTask(void* data) {
+    textureUpload* upload = data;
+    upload->texture = memoryTexture(SDL_CreateTextureFromSurface(initializedNest->renderer, upload->surface));
+
+    if (upload->texture && upload->filtered) {
+        SDL_SetTextureScaleMode(upload->texture, SDL_ScaleModeLinear);
+    }
+
+    if (upload->texture && upload->pixels) {
+        SDL_SetTextureUserData(upload->texture, upload->pixels);
+    }
+}
+
+static texture textureFromSurface(SDL_Surface* s, bool filtered) {
+    textureUpload upload;
+    upload.surface = s;
+    upload.pixels = rasterMode ? memorySurface(SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ARGB8888, 0)) : NULL;
+    upload.texture = NULL;
+    upload.filtered = filtered;
+
+    renderThreadCall(textureUploadTask, &upload);
+
+    if (!upload.texture) {
+        memoryFreeSurface(upload.pixels);
+        return NULL;
+    }
+
+    textureInfoGet(upload.texture)->owned = TRUE;
+
+    return upload.texture;
+}
+
+texture textureLoadEx(char const *path, const textureScaling* scaling) {
+    SDL_Texture* t = NULL;
+    void* buffer = NULL;
+    SDL_Surface* s = imageLoad(path, &buffer);
+    
+    if (!s) {
+        SDL_free(buffer);
+        return NULL;
+    }
+
+    int width = s->w;
+    int height = s->h;
+    float factor = scaling ? textureScaleFactor(scaling, width, height) : 1.0f;
+
+    if (factor < 1.0f) {
+        int w = SDL_max((int)(width * factor + 0.5f), 1);
+        int h = SDL_max((int)(height * factor + 0.5f), 1);
+        SDL_Surface* scaled = textureDownsample(s, w, h, scaling->filter);
+
+        if (scaled) {
+            memoryFreeSurface(s);
+            s = scaled;
+        }
+    }
+
+    bool downscaled = s->w != width || s->h != height;
+
+    t = textureFromSurface(s, downscaled);
+    memoryFreeSurface(s);
+    SDL_free(buffer);
+
+    if (t && downscaled) {
+        textureInfo* info = textureInfoGet(t);
+        info->width = width;
+        info->height = height;
+    }
+
+    return t;
+}
+
+texture textureLoad(char const *path) {
+    return textureLoadEx(path, &textureScalingDefault);
+}
+
+static void renderTexture(texture t, const SDL_Rect* dst) {
+    if (rasterMode) {
+        SDL_Color c = { 255, 255, 255, 255 };
+
+        if (geometryBegin(t, 4, 6)) {
+            int a = geometryVertexUV(dst->x, dst->y, c, 0, 0);
+            int b = geometryVertexUV(dst->x + dst->w, dst->y, c, 1, 0);
+            int d = geometryVertexUV(dst->x + dst->w, dst->y + dst->h, c, 1, 1);
+            int e = geometryVertexUV(dst->x, dst->y + dst->h, c, 0, 1);
+            geometryQuad(a, b, d, e);
+        }
+
+        return;
+    }
+
+    geometryFlush();
+    SDL_SetTextureBlendMode(t, geometryBlendSDL(geometryBlend));
+    SDL_RenderCopy(initializedNest->renderer, t, NULL, dst);
+}
+
+static bool commandTexture(texture t, const SDL_Rect* dst);
+
+bool textureBind(entity* e, texture t)
+{
+    if (!t) {
+        return FALSE;
+    }
+
+    e->tex = t;
+
+    textureInfo* info = textureInfoGet(t);
+
+    SDL_Rect r;
+    r.x = e->position.x;
+    r.y = e->position.y;
+    r.w = info->width;
+    r.h = info->height;
+
+    if (!commandTexture(e->tex, &r)) {
+        renderTexture(e->tex, &r);
+    }
+
+    return TRUE;
+}
+
+static void textureDestroy(texture t) {
+    memoryFreeSurface(SDL_GetTextureUserData(t));
+    memoryDestroyTexture(t);
+}
+
+static void textureRelease(void* data) {
+    textureDestroy(data);
+}
+
+static void textureReleaseForeign(void* data) {
+    SDL_DestroyTexture(data);
+}
+
+// The size cache is keyed on the pointer, so it has to drop a texture before
+// SDL can hand the same address to a new one. Textures the game created keep
+// their user data and never entered the memory counters.
+void textureFree(texture t) {
+    if (t) {
+        renderRelease(textureInfoForget(t) ? textureRelease : textureReleaseForeign, t);
+    }
+}
+
+void textureUnbind(entity* e) {
+    if (e->tex != NULL) {
+        textureFree(e->tex);
+        e->tex = NULL;
+    }
+}
+
+// Sprites
+
+typedef struct spriteEntry {
+    Uint64 key;
+    Uint32 index;
+} spriteEntry;
+
+typedef struct queuedSprite {
+    sprite sprite;
+    int textureWidth;
+    int textureHeight;
+} queuedSprite;
+
+static queuedSprite* spriteQueue;
+static spriteEntry* spriteEntries;
+static spriteEntry* spriteScratch;
+static int spriteCount;
+static int spriteCapacity;
+
+sprite newSprite(texture t, vector2 position) {
+    sprite s;
+    textureInfo* info = textureInfoGet(t);
+
+    s.tex = t;
+    s.source = (SDL_Rect){ 0, 0, info ? info->width : 0, info ? info->height : 0 };
+    s.position = position;
+    s.width = (float)s.source.w;
+    s.height = (float)s.source.h;
+    s.rotation = 0.0f;
+    s.flip = SDL_FLIP_NONE;
+    s.tint = rgb(255, 255, 255);
+    s.layer = 0;
+    s.depth = 0.0f;
+
+    return s;
+}
+
+static Uint64 spriteKey(const sprite* s, const textureInfo* info) {
+    Uint32 depth;
+
+    memcpy(&depth, &s->depth, sizeof(depth));
+    depth = (depth & 0x80000000u) ? ~depth : depth | 0x80000000u;
+
+    return ((Uint64)s->layer << 56) | ((Uint64)depth << 24) | (info->id & 0xFFFFFF);
+}
+
+static void spriteCorners(const sprite* s, vector2 corners[4]) {
+    float hw = s->width / 2;
+    float hh = s->height / 2;
+    float cx = s->position.x + hw;
+    float cy = s->position.y + hh;
+    float rad = s->rotation * (float)M_PI / 180.0f;
+    float cs = cosf(rad);
+    float sn = sinf(rad);
+    const float ox[4] = { -hw, hw, hw, -hw };
+    const float oy[4] = { -hh, -hh, hh, hh };
+
+    for (int i = 0; i < 4; i++) {
+        corners[i].x = cx + ox[i] * cs - oy[i] * sn;
+        corners[i].y = cy + ox[i] * sn + oy[i] * cs;
+    }
+}
+
+static void spriteQueueAdd(const sprite* s, const textureInfo* info) {
+    if (!s->tex || !info) {
+        return;
+    }
+
+    if (spriteCount == spriteCapacity) {
+        int capacity = spriteCapacity ? spriteCapacity * 2 : 256;
+        queuedSprite* queue = memoryRealloc(MEMORY_RENDER, spriteQueue, capacity * sizeof(queuedSprite));
+        spriteEntry* entries = memoryRealloc(MEMORY_RENDER, spriteEntries, capacity * sizeof(spriteEntry));
+        spriteEntry* scratch = memoryRealloc(MEMORY_RENDER, spriteScratch, capacity * sizeof(spriteEntry));
+
+        if (queue) {
+            spriteQueue = queue;
+        }
+
+        if (entries) {
+            spriteEntries = entries;
+        }
+
+        if (scratch) {
+            spriteScratch = scratch;
+        }
+
+        if (!queue || !entries || !scratch) {
+            return;
+        }
+
+        spriteCapacity = capacity;
+    }
+
+    spriteQueue[spriteCount].sprite = *s;
+    spriteQueue[spriteCount].textureWidth = info->width;
+    spriteQueue[spriteCount].textureHeight = info->height;
+    spriteEntries[spriteCount].key = spriteKey(s, info);
+    spriteEntries[spriteCount].index = spriteCount;
+    spriteCount++;
+}
+
+static void spriteSort(void) {
+    spriteEntry* from = spriteEntries;
+    spriteEntry* to = spriteScratch;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256] = { 0 };
+
+        for (int i = 0; i < spriteCount; i++) {
+            counts[(from[i].key >> shift) & 0xFF]++;
+        }
+
+        if (counts[(from[0].key >> shift) & 0xFF] == spriteCount) {
+            continue;
+        }
+
+        for (int i = 0, total = 0; i < 256; i++) {
+            int c = counts[i];
+            counts[i] = total;
+            total += c;
+        }
+
+        for (int i = 0; i < spriteCount; i++) {
+            to[counts[(from[i].key >> shift) & 0xFF]++] = from[i];
+        }
+
+        spriteEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+
+    spriteEntries = from;
+    spriteScratch = to;
+}
+
+static void spriteEmit(const queuedSprite* q) {
+    const sprite* s = &q->sprite;
+
+    if (q->textureWidth <= 0 || q->textureHeight <= 0 || !geometryBegin(s->tex, 4, 6)) {
+        return;
+    }
+
+    SDL_Color c = colorSDL(s->tint);
+    float u0 = (float)s->source.x / q->textureWidth;
+    float v0 = (float)s->source.y / q->textureHeight;
+    float u1 = (float)(s->source.x + s->source.w) / q->textureWidth;
+    float v1 = (float)(s->source.y + s->source.h) / q->textureHeight;
+    vector2 corners[4];
+
+    if (s->flip & SDL_FLIP_HORIZONTAL) {
+        float u = u0;
+        u0 = u1;
+        u1 = u;
+    }
+
+    if (s->flip & SDL_FLIP_VERTICAL) {
+        float v = v0;
+        v0 = v1;
+        v1 = v;
+    }
+
+    spriteCorners(s, corners);
+
+    int a = geometryVertexUV(corners[0].x, corners[0].y, c, u0, v0);
+    int b = geometryVertexUV(corners[1].x, corners[1].y, c, u1, v0);
+    int d = geometryVertexUV(corners[2].x, corners[2].y, c, u1, v1);
+    int e = geometryVertexUV(corners[3].x, corners[3].y, c, u0, v1);
+    geometryQuad(a, b, d, e);
+}
+
+static void spriteBatchFlush(void) {
+    if (spriteCount == 0) {
+        return;
+    }
+
+    spriteSort();
+
+    for (int i = 0; i < spriteCount; i++) {
+        spriteEmit(&spriteQueue[spriteEntries[i].index]);
+    }
+
+    geometryFlush();
+    spriteCount = 0;
+}
+
+static bool commandSprite(sprite* s);
+static bool commandSpriteFlush(void);
+
+void drawSprite(sprite* s) {
+    if (s && !commandSprite(s)) {
+        spriteQueueAdd(s, textureInfoGet(s->tex));
+    }
+}
+
+void spriteFlush(void) {
+    if (!commandSpriteFlush()) {
+        spriteBatchFlush();
+    }
+}
+
+static void spritesFree(void) {
+    memoryFree(spriteQueue);
+    memoryFree(spriteEntries);
+    memoryFree(spriteScratch);
+    spriteQueue = NULL;
+    spriteEntries = NULL;
+    spriteScratch = NULL;
+    spriteCount = 0;
+    spriteCapacity = 0;
+}
+
+// Layers
+
+typedef struct layerMember {
+    bool isPrimitive;
+    union {
+        primitive* p;
+        entity* e;
+    } ref;
+    union {
+        primitive p;
+        entity e;
+    } snapshot;
+    int width;
+    int height;
+} layerMember;
+
+struct layer {
+    char* name;
+    bool isStatic;
+    bool dirty;
+    Uint32 version;
+    layerMember* members;
+    int count;
+    int capacity;
+    SDL_Texture* baked;
+    SDL_atomic_t lost;
+    struct layer* next;
+};
+
+static layer* layers;
+static SDL_atomic_t layerBakeUnsupported;
+
+layer* layerCreate(const char* name, bool isStatic) {
+    layer* l = memoryCalloc(MEMORY_RENDER, 1, sizeof(layer));
+
+    if (!l) {
+        return NULL;
+    }
+
+    size_t length = strlen(name ? name : "") + 1;
+    l->name = memoryAlloc(MEMORY_RENDER, length);
+
+    if (!l->name) {
+        memoryFree(l);
+        return NULL;
+    }
+
+    memcpy(l->name, name ? name : "", length);
+
+    l->isStatic = isStatic;
+    l->dirty = TRUE;
+    l->next = layers;
+    layers = l;
+
+    return l;
+}
+
+layer* layerGet(const char* name) {
+    for (layer* l = layers; l; l = l->next) {
+        if (strcmp(l->name, name) == 0) {
+            return l;
+        }
+    }
+
+    return NULL;
+}
+
+static void layerRelease(void* data) {
+    layer* l = data;
+
+    if (l->baked) {
+        memoryDestroyTexture(l->baked);
+    }
+
+    memoryFree(l->name);
+    memoryFree(l->members);
+    memoryFree(l);
+}
+
+void layerDestroy(layer* l) {
+    if (!l) {
+        return;
+    }
+
+    for (layer** it = &layers; *it; it = &(*it)->next) {
+        if (*it == l) {
+            *it = l->next;
+            break;
+        }
+    }
+
+    renderRelease(layerRelease, l);
+}
+
+void layerSetStatic(layer* l, bool isStatic) {
+    if (l) {
+        l->isStatic = isStatic;
+        l->dirty = TRUE;
+    }
+}
+
+static layerMember* layerAppend(layer* l) {
+    if (l->count == l->capacity) {
+        int capacity = l->capacity ? l->capacity * 2 : 16;
+        layerMember* members = memoryRealloc(MEMORY_RENDER, l->members, capacity * sizeof(layerMember));
+
+        if (!members) {
+            return NULL;
+        }
+
+        l->members = members;
+        l->capacity = capacity;
+    }
+
+    l->dirty = TRUE;
+
+    return &l->members[l->count++];
+}
+
+static void layerMeasure(layerMember* m) {
+    textureInfo* info = textureInfoGet(m->snapshot.e.tex);
+
+    m->width = info ? info->width : 0;
+    m->height = info ? info->height : 0;
+}
+
+bool layerAddPrimitive(layer* l, primitive* p) {
+    layerMember* m;
+
+    if (!l || !p || !(m = layerAppend(l))) {
+        return FALSE;
+    }
+
+    m->isPrimitive = TRUE;
+    m->ref.p = p;
+    memcpy(&m->snapshot.p, p, sizeof(primitive));
+
+    return TRUE;
+}
+
+bool layerAddEntity(layer* l, entity* e) {
+    layerMember* m;
+
+    if (!l || !e || !(m = layerAppend(l))) {
+        return FALSE;
+    }
+
+    m->isPrimitive = FALSE;
+    m->ref.e = e;
+    memcpy(&m->snapshot.e, e, sizeof(entity));
+    layerMeasure(m);
+
+    return TRUE;
+}
+
+void layerRemove(layer* l, entity* e) {
+    if (!l) {
+        return;
+    }
+
+    for (int i = 0; i < l->count; i++) {
+        entity* member = l->members[i].isPrimitive ? &l->members[i].ref.p->base : l->members[i].ref.e;
+
+        if (member == e) {
+            memmove(&l->members[i], &l->members[i + 1], (l->count - i - 1) * sizeof(layerMember));
+            l->count--;
+            l->dirty = TRUE;
+            return;
+        }
+    }
+}
+
+void layerClear(layer* l) {
+    if (l) {
+        l->count = 0;
+        l->dirty = TRUE;
+    }
+}
+
+void layerDirty(layer* l) {
+    if (l) {
+        l->dirty = TRUE;
+    }
+}
+
+static bool layerPrimitiveEqual(const primitive* a, const primitive* b) {
+    if (a->type != b->type || a->filled != b->filled || a->base.isActive != b->base.isActive ||
+        a->base.position.x != b->base.position.x || a->base.position.y != b->base.position.y ||
+        memcmp(&a->color, &b->color, sizeof(color)) != 0) {
+        return FALSE;
+    }
+
+    switch (a->type) {
+        case RECTANGLE:
+            return a->rectangle.width == b->rectangle.width && a->rectangle.height == b->rectangle.height;
+        case CIRCLE:
+            return a->circle.radius == b->circle.radius && a->circle.segments == b->circle.segments;
+        case TRIANGLE:
+            return a->triangle.base == b->triangle.base && a->triangle.height == b->triangle.height &&
+                   a->triangle.skew == b->triangle.skew;
+        case LINE:
+            return a->line.endPoint.x == b->line.endPoint.x && a->line.endPoint.y == b->line.endPoint.y &&
+                   a->line.width == b->line.width && a->line.cap == b->line.cap;
+        default:
+            return TRUE;
+    }
+}
+
+static bool layerEntityEqual(const entity* a, const entity* b) {
+    return a->tex == b->tex && a->isActive == b->isActive &&
+           a->position.x == b->position.x && a->position.y == b->position.y;
+}
+
+static bool layerRefresh(layer* l) {
+    bool changed = l->dirty || SDL_AtomicSet(&l->lost, 0);
+
+    for (int i = 0; i < l->count; i++) {
+        layerMember* m = &l->members[i];
+
+        if (m->isPrimitive && !layerPrimitiveEqual(&m->snapshot.p, m->ref.p)) {
+            memcpy(&m->snapshot.p, m->ref.p, sizeof(primitive));
+            changed = TRUE;
+        }
+        else if (!m->isPrimitive && !layerEntityEqual(&m->snapshot.e, m->ref.e)) {
+            memcpy(&m->snapshot.e, m->ref.e, sizeof(entity));
+            layerMeasure(m);
+            changed = TRUE;
+        }
+    }
+
+    l->dirty = FALSE;
+
+    if (changed) {
+        l->version++;
+    }
+
+    return changed;
+}
+
+static void layerDrawMembers(const layerMember* members, int count) {
+    for (int i = 0; i < count; i++) {
+        const layerMember* m = &members[i];
+
+        if (m->isPrimitive) {
+            if (m->snapshot.p.base.isActive) {
+                primitive p = m->snapshot.p;
+                renderPrimitive(&p);
+            }
+        }
+        else if (m->snapshot.e.isActive && m->snapshot.e.tex) {
+            SDL_Rect r = { (int)m->snapshot.e.position.x, (int)m->snapshot.e.position.y, m->width, m->height };
+            renderTexture(m->snapshot.e.tex, &r);
+        }
+    }
+}
+
+// Members are blended over transparent black, which leaves the baked texture
+// premultiplied, so compositing it has to use premultiplied factors or
+// anything translucent gets its alpha applied twice.
+static SDL_BlendMode layerCompositeMode(blendMode mode) {
+    switch (mode) {
+        case BLEND_ADD:
+            return SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD,
+                                              SDL_BLENDFACTOR_ZERO, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
+        case BLEND_MULTIPLY:
+            return SDL_BLENDMODE_MUL;
+        case BLEND_NONE:
+            return SDL_BLENDMODE_NONE;
+        default:
+            return SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+                                              SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    }
+}
+
+static bool layerBake(layer* l, const layerMember* members, int count) {
+    SDL_Renderer* r = initializedNest->renderer;
+    int w, h, tw = 0, th = 0;
+
+    if (rasterMode || SDL_AtomicGet(&layerBakeUnsupported) || !SDL_RenderTargetSupported(r) || SDL_GetRendererOutputSize(r, &w, &h) != 0) {
+        return FALSE;
+    }
+
+    if (l->baked) {
+        SDL_QueryTexture(l->baked, NULL, NULL, &tw, &th);
+
+        if (tw != w || th != h) {
+            memoryDestroyTexture(l->baked);
+            l->baked = NULL;
+        }
+    }
+
+    if (!l->baked) {
+        l->baked = memoryTexture(SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h));
+
+        if (!l->baked) {
+            return FALSE;
+        }
+    }
+
+    if (SDL_SetTextureBlendMode(l->baked, layerCompositeMode(BLEND_ALPHA)) != 0) {
+        memoryDestroyTexture(l->baked);
+        l->baked = NULL;
+        SDL_AtomicSet(&layerBakeUnsupported, 1);
+        return FALSE;
+    }
+
+    blendMode blend = geometryBlend;
+    geometryFlush();
+    geometryBlend = BLEND_ALPHA;
+
+    SDL_Texture* previous = SDL_GetRenderTarget(r);
+    SDL_SetRenderTarget(r, l->baked);
+    SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+    SDL_RenderClear(r);
+
+    layerDrawMembers(members, count);
+    geometryFlush();
+
+    SDL_SetRenderTarget(r, previous);
+    geometryBlend = blend;
+
+    return TRUE;
+}
+
+// Renderers without custom blend modes can't composite a premultiplied bake,
+// so their static layers draw member by member like dynamic ones.
+static void renderLayer(layer* l, bool isStatic, bool rebake, const layerMember* members, int count) {
+    if (!isStatic || (members && SDL_AtomicGet(&layerBakeUnsupported))) {
+        layerDrawMembers(members, count);
+        return;
+    }
+
+    if (rebake || !l->baked) {
+        if (!members) {
+            SDL_AtomicSet(&l->lost, 1);
+            return;
+        }
+
+        if (!layerBake(l, members, count)) {
+            layerDrawMembers(members, count);
+
+            if (!SDL_AtomicGet(&layerBakeUnsupported)) {
+                SDL_AtomicSet(&l->lost, 1);
+            }
+
+            return;
+        }
+    }
+
+    geometryFlush();
+    SDL_SetTextureBlendMode(l->baked, layerCompositeMode(geometryBlend));
+    SDL_RenderCopy(initializedNest->renderer, l->baked, NULL, NULL);
+}
+
+static bool commandLayer(layer* l);
+
+void drawLayer(layer* l) {
+    if (l && !commandLayer(l)) {
+        bool changed = layerRefresh(l);
+        renderLayer(l, l->isStatic, changed, l->members, l->count);
+    }
+}
+
+static void layersInvalidate(bool deviceLost) {
+    if (deviceLost) {
+        SDL_AtomicSet(&layerBakeUnsupported, 0);
+    }
+
+    for (layer* l = layers; l; l = l->next) {
+        if (deviceLost && l->baked) {
+            memoryDestroyTexture(l->baked);
+            l->baked = NULL;
+        }
+
+        SDL_AtomicSet(&l->lost, 1);
+    }
+}
+
+static void layersFree(void) {
+    while (layers) {
+        layer* l = layers;
+        layers = l->next;
+        layerRelease(l);
+    }
+}
+
+// Commands
+
+#define COMMAND_MAX_DIRTY_RECTS 32
+
+typedef enum {
+    COMMAND_PRIMITIVE,
+    COMMAND_POLYLINE,
+    COMMAND_TEXTURE,
+    COMMAND_LAYER,
+    COMMAND_SPRITE,
+    COMMAND_SPRITE_FLUSH,
+    COMMAND_TILEMAP,
+    COMMAND_TEXT,
+    COMMAND_BLEND
+} commandType;
+
+typedef struct command {
+    commandType type;
+    SDL_Rect bounds;
+    Uint32 hash;
+    union {
+        primitive primitive;
+        struct { size_t first; int count; float width; lineJoin join; lineCap cap; color color; } polyline;
+        struct { texture tex; SDL_Rect dst; } texture;
+        struct { layer* layer; bool isStatic; bool rebake; size_t first; int count; } layer;
+        struct { sprite sprite; textureInfo info; } sprite;
+        struct { tilemap* map; vector2 offset; size_t first; int count; } tilemap;
+        struct { font* font; vector2 position; float scale; SDL_Color color; size_t first; int count; } text;
+        blendMode blend;
+    };
+} command;
+
+typedef struct commandRelease {
+    void (*release)(void*);
+    void* data;
+} commandRelease;
+
+typedef struct commandList {
+    command* commands;
+    int count;
+    int capacity;
+    Uint8* data;
+    size_t dataSize;
+    size_t dataCapacity;
+    commandRelease* releases;
+    int releaseCount;
+    int releaseCapacity;
+} commandList;
+
+static commandList commandLists[2];
+static commandList* commandsCurrent = &commandLists[0];
+static commandList* commandsPrevious = &commandLists[1];
+static bool commandRecording;
+static bool commandsFullRedraw = TRUE;
+static color commandsBackground;
+static SDL_Rect commandsScreen;
+
+static Uint32 commandHash(Uint32 hash, const void* data, size_t size) {
+    const Uint8* bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static Uint32 primitiveHash(const primitive* p) {
+    Uint32 hash = commandHash(2166136261u, &p->base.position, sizeof(vector2));
+
+    hash = commandHash(hash, &p->type, sizeof(p->type));
+    hash = commandHash(hash, &p->color, sizeof(color));
+    hash = commandHash(hash, &p->filled, sizeof(p->filled));
+
+    switch (p->type) {
+        case RECTANGLE:
+            hash = commandHash(hash, &p->rectangle.width, sizeof(float));
+            hash = commandHash(hash, &p->rectangle.height, sizeof(float));
+            break;
+        case CIRCLE:
+            hash = commandHash(hash, &p->circle.radius, sizeof(float));
+            hash = commandHash(hash, &p->circle.segments, sizeof(int));
+            break;
+        case TRIANGLE:
+            hash = commandHash(hash, &p->triangle.base, sizeof(float));
+            hash = commandHash(hash, &p->triangle.height, sizeof(float));
+            hash = commandHash(hash, &p->triangle.skew, sizeof(float));
+            break;
+        case LINE:
+            hash = commandHash(hash, &p->line.endPoint, sizeof(vector2));
+            hash = commandHash(hash, &p->line.width, sizeof(float));
+            hash = commandHash(hash, &p->line.cap, sizeof(lineCap));
+            break;
+        default:
+            break;
+    }
+
+    return hash;
+}
+
+static SDL_Rect commandBounds(float minX, float minY, float maxX, float maxY, float margin) {
+    SDL_Rect r;
+
+    r.x = (int)floorf(minX - margin);
+    r.y = (int)floorf(minY - margin);
+    r.w = (int)ceilf(maxX + margin) - r.x + 1;
+    r.h = (int)ceilf(maxY + margin) - r.y + 1;
+
+    return r;
+}
+
+static size_t commandData(commandList* list, const void* data, size_t size) {
+    size_t offset = (list->dataSize + 15) & ~(size_t)15;
+
+    if (offset + size > list->dataCapacity) {
+        size_t capacity = list->dataCapacity ? list->dataCapacity : 16384;
+
+        while (capacity < offset + size) {
+            capacity *= 2;
+        }
+
+        Uint8* stored = memoryRealloc(MEMORY_RENDER, list->data, capacity);
+
+        if (!stored) {
+            return (size_t)-1;
+        }
+
+        list->data = stored;
+        list->dataCapacity = capacity;
+    }
+
+    if (data) {
+        memcpy(list->data + offset, data, size);
+    }
+
+    list->dataSize = offset + size;
+
+    return offset;
+}
+
+static void renderRelease(void (*release)(void*), void* data) {
+    commandList* list = commandsCurrent;
+
+    if (list->releaseCount == list->releaseCapacity) {
+        int capacity = list->releaseCapacity ? list->releaseCapacity * 2 : 16;
+        commandRelease* releases = memoryRealloc(MEMORY_RENDER, list->releases, capacity * sizeof(commandRelease));
+
+        if (!releases) {
+            spriteBatchFlush();
+            geometryFlush();
+            textBatchFlush();
+            release(data);
+            return;
+        }
+
+        list->releases = releases;
+        list->releaseCapacity = capacity;
+    }
+
+    list->releases[list->releaseCount].release = release;
+    list->releases[list->releaseCount].data = data;
+    list->releaseCount++;
+}
+
+static void commandsRunReleases(commandList* list) {
+    for (int i = 0; i < list->releaseCount; i++) {
+        list->releases[i].release(list->releases[i].data);
+    }
+
+    list->releaseCount = 0;
+}
+
+static command* commandPush(commandType type) {
+    commandList* list = commandsCurrent;
+
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        command* commands = memoryRealloc(MEMORY_RENDER, list->commands, capacity * sizeof(command));
+
+        if (!commands) {
+            return NULL;
+        }
+
+        list->commands = commands;
+        list->capacity = capacity;
+    }
+
+    command* c = &list->commands[list->count++];
+    c->type = type;
+
+    return c;
+}
+
+static bool commandPrimitive(primitive* p) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_PRIMITIVE);
+
+    if (!c) {
+        return TRUE;
+    }
+
+    memcpy(&c->primitive, p, sizeof(primitive));
+    c->hash = primitiveHash(p);
+
+    float x = p->base.position.x;
+    float y = p->base.position.y;
+
+    switch (p->type) {
+        case RECTANGLE:
+            c->bounds = commandBounds(SDL_min(x, x + p->rectangle.width), SDL_min(y, y + p->rectangle.height),
+                                      SDL_max(x, x + p->rectangle.width), SDL_max(y, y + p->rectangle.height), 1);
+            break;
+        case CIRCLE:
+            c->bounds = commandBounds(x, y, x, y, fabsf(p->circle.radius) + 1);
+            break;
+        case TRIANGLE: {
+            float tx = x + p->triangle.base / 2 + p->triangle.skew;
+            float ty = y - p->triangle.height;
+            c->bounds = commandBounds(SDL_min(SDL_min(x, x + p->triangle.base), tx), SDL_min(y, ty),
+                                      SDL_max(SDL_max(x, x + p->triangle.base), tx), SDL_max(y, ty), 1);
+            break;
+        }
+        case LINE:
+            c->bounds = commandBounds(SDL_min(x, p->line.endPoint.x), SDL_min(y, p->line.endPoint.y),
+                                      SDL_max(x, p->line.endPoint.x), SDL_max(y, p->line.endPoint.y),
+                                      SDL_max(p->line.width, 1.0f) / 2 + 1);
+            break;
+        default:
+            c->bounds = (SDL_Rect){ 0, 0, 0, 0 };
+            break;
+    }
+
+    return TRUE;
+}
+
+static bool commandPolyline(vector2* points, int count, float width, lineJoin join, lineCap cap, color color) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    size_t first = commandData(commandsCurrent, points, count * sizeof(vector2));
+    command* c = first != (size_t)-1 ? commandPush(COMMAND_POLYLINE) : NULL;
+
+    if (!c) {
+        return TRUE;
+    }
+
+    float minX = points[0].x, minY = points[0].y, maxX = points[0].x, maxY = points[0].y;
+
+    for (int i = 1; i < count; i++) {
+        minX = SDL_min(minX, points[i].x);
+        minY = SDL_min(minY, points[i].y);
+        maxX = SDL_max(maxX, points[i].x);
+        maxY = SDL_max(maxY, points[i].y);
+    }
+
+    c->polyline.first = first;
+    c->polyline.count = count;
+    c->polyline.width = width;
+    c->polyline.join = join;
+    c->polyline.cap = cap;
+    c->polyline.color = color;
+    c->bounds = commandBounds(minX, minY, maxX, maxY, SDL_max(width, 1.0f) / 2 * STROKE_MITER_LIMIT + 1);
+    c->hash = commandHash(2166136261u, points, count * sizeof(vector2));
+    c->hash = commandHash(c->hash, &width, sizeof(width));
+    c->hash = commandHash(c->hash, &join, sizeof(join));
+    c->hash = commandHash(c->hash, &cap, sizeof(cap));
+    c->hash = commandHash(c->hash, &color, sizeof(color));
+
+    return TRUE;
+}
+
+static bool commandTexture(texture t, const SDL_Rect* dst) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_TEXTURE);
+
+    if (c) {
+        SDL_Rect src = { 0, 0, 0, 0 };
+        Uint8 mod[4] = { 255, 255, 255, 255 };
+
+        SDL_QueryTexture(t, NULL, NULL, &src.w, &src.h);
+        SDL_GetTextureColorMod(t, &mod[0], &mod[1], &mod[2]);
+        SDL_GetTextureAlphaMod(t, &mod[3]);
+
+        c->texture.tex = t;
+        c->texture.dst = *dst;
+        c->bounds = *dst;
+        c->hash = commandHash(2166136261u, &t, sizeof(t));
+        c->hash = commandHash(c->hash, dst, sizeof(*dst));
+        c->hash = commandHash(c->hash, &src, sizeof(src));
+        c->hash = commandHash(c->hash, mod, sizeof(mod));
+    }
+
+    return TRUE;
+}
+
+static bool commandLayer(layer* l) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_LAYER);
+
+    if (c) {
+        bool changed = layerRefresh(l);
+
+        c->layer.layer = l;
+        c->layer.isStatic = l->isStatic;
+        c->layer.rebake = changed;
+        c->layer.first = (size_t)-1;
+        c->layer.count = l->count;
+
+        if (changed || !l->isStatic || SDL_AtomicGet(&layerBakeUnsupported)) {
+            c->layer.first = commandData(commandsCurrent, l->members, l->count * sizeof(layerMember));
+        }
+
+        c->bounds = commandsScreen;
+        c->hash = commandHash(commandHash(2166136261u, &l, sizeof(l)), &l->version, sizeof(l->version));
+    }
+
+    return TRUE;
+}
+
+static bool commandSprite(sprite* s) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_SPRITE);
+
+    if (c) {
+        vector2 corners[4];
+        float minX, minY, maxX, maxY;
+
+        spriteCorners(s, corners);
+        minX = maxX = corners[0].x;
+        minY = maxY = corners[0].y;
+
+        for (int i = 1; i < 4; i++) {
+            minX = SDL_min(minX, corners[i].x);
+            minY = SDL_min(minY, corners[i].y);
+            maxX = SDL_max(maxX, corners[i].x);
+            maxY = SDL_max(maxY, corners[i].y);
+        }
+
+        c->sprite.sprite = *s;
+        c->sprite.info = *textureInfoGet(s->tex);
+        c->bounds = commandBounds(minX, minY, maxX, maxY, 1);
+        c->hash = commandHash(2166136261u, &s->tex, sizeof(s->tex));
+        c->hash = commandHash(c->hash, &s->source, sizeof(s->source));
+        c->hash = commandHash(c->hash, &s->position, sizeof(s->position));
+        c->hash = commandHash(c->hash, &s->width, sizeof(s->width));
+        c->hash = commandHash(c->hash, &s->height, sizeof(s->height));
+        c->hash = commandHash(c->hash, &s->rotation, sizeof(s->rotation));
+        c->hash = commandHash(c->hash, &s->flip, sizeof(s->flip));
+        c->hash = commandHash(c->hash, &s->tint, sizeof(s->tint));
+        c->hash = commandHash(c->hash, &s->layer, sizeof(s->layer));
+        c->hash = commandHash(c->hash, &s->depth, sizeof(s->depth));
+    }
+
+    return TRUE;
+}
+
+static bool commandSpriteFlush(void) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_SPRITE_FLUSH);
+
+    if (c) {
+        c->bounds = commandsScreen;
+        c->hash = 0;
+    }
+
+    return TRUE;
+}
+
+static int tilemapPlan(tilemap* m, vector2 offset, SDL_Rect screen, commandList* list, size_t* first);
+static void renderTilemap(tilemap* m, vector2 offset, const Uint8* data, size_t first, int count);
+static Uint32 tilemapVersion(tilemap* m);
+
+typedef struct textGlyph textGlyph;
+
+static size_t textStore(commandList* list, const textGlyph* glyphs, int count);
+static void renderText(const font* f, const textGlyph* glyphs, int count, vector2 position, float scale, SDL_Color c);
+
+static bool commandText(font* f, const textGlyph* glyphs, int count, Uint64 layoutHash, vector2 size, vector2 position, float scale, color color) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    size_t first = textStore(commandsCurrent, glyphs, count);
+    command* c = first != (size_t)-1 ? commandPush(COMMAND_TEXT) : NULL;
+
+    if (c) {
+        c->text.font = f;
+        c->text.position = position;
+        c->text.scale = scale;
+        c->text.color = colorSDL(color);
+        c->text.first = first;
+        c->text.count = count;
+        c->bounds = commandBounds(position.x, position.y, position.x + size.x * scale, position.y + size.y * scale, 1);
+        c->hash = commandHash(2166136261u, &layoutHash, sizeof(layoutHash));
+        c->hash = commandHash(c->hash, &position, sizeof(position));
+        c->hash = commandHash(c->hash, &scale, sizeof(scale));
+        c->hash = commandHash(c->hash, &c->text.color, sizeof(c->text.color));
+    }
+
+    return TRUE;
+}
+
+static bool commandTilemap(tilemap* m, vector2 offset) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_TILEMAP);
+
+    if (c) {
+        Uint32 version = tilemapVersion(m);
+
+        c->tilemap.map = m;
+        c->tilemap.offset = offset;
+        c->tilemap.count = tilemapPlan(m, offset, commandsScreen, commandsCurrent, &c->tilemap.first);
+        c->bounds = commandsScreen;
+        c->hash = commandHash(2166136261u, &m, sizeof(m));
+        c->hash = commandHash(c->hash, &offset, sizeof(offset));
+        c->hash = commandHash(c->hash, &version, sizeof(version));
+    }
+
+    return TRUE;
+}
+
+// A blend change covers the whole screen so that every dirty rectangle replays
+// it, and any change to where it falls in the frame redraws everything.
+static bool commandBlend(blendMode mode) {
+    if (!commandRecording) {
+        return FALSE;
+    }
+
+    command* c = commandPush(COMMAND_BLEND);
+
+    if (c) {
+        c->blend = mode;
+        c->bounds = commandsScreen;
+        c->hash = commandHash(2166136261u, &mode, sizeof(mode));
+    }
+
+    return TRUE;
+}
+
+static void commandExecute(commandList* list, command* c) {
+    switch (c->type) {
+        case COMMAND_PRIMITIVE:
+            renderPrimitive(&c->primitive);
+            break;
+        case COMMAND_POLYLINE:
+            renderPolyline((vector2*)(list->data + c->polyline.first), c->polyline.count, c->polyline.width,
+                           c->polyline.join, c->polyline.cap, c->polyline.color);
+            break;
+        case COMMAND_TEXTURE:
+            renderTexture(c->texture.tex, &c->texture.dst);
+            break;
+        case COMMAND_LAYER:
+            renderLayer(c->layer.layer, c->layer.isStatic, c->layer.rebake,
+                        c->layer.first != (size_t)-1 ? (layerMember*)(list->data + c->layer.first) : NULL,
+                        c->layer.count);
+            break;
+        case COMMAND_SPRITE:
+            spriteQueueAdd(&c->sprite.sprite, &c->sprite.info);
+            break;
+        case COMMAND_SPRITE_FLUSH:
+            spriteBatchFlush();
+            break;
+        case COMMAND_TILEMAP:
+            renderTilemap(c->tilemap.map, c->tilemap.offset, list->data, c->tilemap.first, c->tilemap.count);
+            break;
+        case COMMAND_TEXT:
+            renderText(c->text.font, (const textGlyph*)(list->data + c->text.first), c->text.count,
+                       c->text.position, c->text.scale, c->text.color);
+            break;
+        case COMMAND_BLEND:
+            renderBlend(c->blend);
+            break;
+        default:
+            break;
+    }
+}
+
+static void commandsBeginFrame(bool record) {
+    commandList* list = commandsCurrent;
+
+    commandsCurrent = commandsPrevious;
+    commandsPrevious = list;
+    commandsRunReleases(commandsCurrent);
+    commandsCurrent->count = 0;
+    commandsCurrent->dataSize = 0;
+    commandRecording = record;
+    drawBlend = BLEND_ALPHA;
+    renderBlend(BLEND_ALPHA);
+
+    commandsScreen = (SDL_Rect){ 0, 0, 0, 0 };
+    SDL_GetRendererOutputSize(initializedNest->renderer, &commandsScreen.w, &commandsScreen.h);
+}
+
+static void commandsRenderSubmitted(void) {
+    commandList* list = commandsPrevious;
+
+    renderBlend(BLEND_ALPHA);
+
+    for (int i = 0; i < list->count; i++) {
+        commandExecute(list, &list->commands[i]);
+    }
+
+    spriteBatchFlush();
+    geometryFlush();
+    textBatchFlush();
+}
+
+static void commandsEndFrame(bool submitted) {
+    commandsRunReleases(submitted ? commandsPrevious : commandsCurrent);
+}
+
+static void commandsInvalidate(void) {
+    commandsFullRedraw = TRUE;
+}
+
+static int commandsAddDirty(SDL_Rect* rects, int count, SDL_Rect r) {
+    if (r.w <= 0 || r.h <= 0) {
+        return count;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (SDL_HasIntersection(&rects[i], &r)) {
+            SDL_Rect merged;
+            SDL_UnionRect(&rects[i], &r, &merged);
+            rects[i] = rects[--count];
+            return commandsAddDirty(rects, count, merged);
+        }
+    }
+
+    if (count == COMMAND_MAX_DIRTY_RECTS) {
+        for (int i = 1; i < count; i++) {
+            SDL_UnionRect(&rects[0], &rects[i], &rects[0]);
+        }
+
+        count = 1;
+        SDL_UnionRect(&rects[0], &r, &rects[0]);
+        return count;
+    }
+
+    rects[count] = r;
+    return count + 1;
+}
+
+static void commandsPresentDirty(SDL_Window* window) {
+    SDL_Renderer* renderer = initializedNest->renderer;
+    commandList* current = commandsCurrent;
+    commandList* previous = commandsPrevious;
+    SDL_Rect screen = commandsScreen;
+    SDL_Rect rects[COMMAND_MAX_DIRTY_RECTS];
+    int count = 0;
+
+    commandRecording = FALSE;
+
+    if (memcmp(&commandsBackground, &backgroundColor, sizeof(color)) != 0) {
+        commandsBackground = backgroundColor;
+        commandsFullRedraw = TRUE;
+    }
+
+    if (commandsFullRedraw) {
+        rects[count++] = screen;
+        commandsFullRedraw = FALSE;
+    }
+    else {
+        int shared = SDL_min(current->count, previous->count);
+
+        for (int i = 0; i < shared; i++) {
+            command* a = &current->commands[i];
+            command* b = &previous->commands[i];
+
+            if (a->hash != b->hash || !SDL_RectEquals(&a->bounds, &b->bounds)) {
+                count = commandsAddDirty(rects, count, a->bounds);
+                count = commandsAddDirty(rects, count, b->bounds);
+            }
+        }
+
+        for (int i = shared; i < current->count; i++) {
+            count = commandsAddDirty(rects, count, current->commands[i].bounds);
+        }
+
+        for (int i = shared; i < previous->count; i++) {
+            count = commandsAddDirty(rects, count, previous->commands[i].bounds);
+        }
+    }
+
+    int visible = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (SDL_IntersectRect(&rects[i], &screen, &rects[visible])) {
+            visible++;
+        }
+    }
+
+    for (int i = 0; i < visible; i++) {
+        SDL_RenderSetClipRect(renderer, &rects[i]);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(renderer, backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
+        SDL_RenderFillRect(renderer, &rects[i]);
+        renderBlend(BLEND_ALPHA);
+
+        for (int j = 0; j < current->count; j++) {
+            if (SDL_HasIntersection(&current->commands[j].bounds, &rects[i])) {
+                commandExecute(current, &current->commands[j]);
+            }
+        }
+
+        spriteBatchFlush();
+        geometryFlush();
+        textBatchFlush();
+    }
+
+    SDL_RenderSetClipRect(renderer, NULL);
+    SDL_RenderFlush(renderer);
+
+    if (visible > 0) {
+        SDL_UpdateWindowSurfaceRects(window, rects, visible);
+    }
+
+    commandsRunReleases(current);
+}
+
+static void commandsFree(void) {
+    for (int i = 0; i < 2; i++) {
+        commandsRunReleases(&commandLists[i]);
+        memoryFree(commandLists[i].commands);
+        memoryFree(commandLists[i].data);
+        memoryFree(commandLists[i].releases);
+        SDL_zero(commandLists[i]);
+    }
+
+    commandRecording = FALSE;
+    commandsFullRedraw = TRUE;
+}
+
+// Tilemaps
+
+#define TILEMAP_CHUNK_PIXELS 512
+#define TILEMAP_CACHE_SIZE 64
+
+typedef struct tilemapChunk {
+    int slot;
+    bool dirty;
+    Uint32 lastUsed;
+} tilemapChunk;
+
+typedef struct tilemapOp {
+    int chunk;
+    int slot;
+    size_t tiles;
+} tilemapOp;
+
+struct tilemap {
+    texture tileset;
+    int tileWidth;
+    int tileHeight;
+    int tilesetColumns;
+    int tilesetTiles;
+    int tilesetWidth;
+    int tilesetHeight;
+    bool direct;
+    int columns;
+    int rows;
+    int chunkSize;
+    int chunkColumns;
+    int chunkRows;
+    Sint32* tiles;
+    tilemapChunk* chunks;
+    int* slotChunks;
+    SDL_Texture** slotTextures;
+    int cacheSize;
+    Uint32 frame;
+    Uint32 version;
+    SDL_atomic_t lost;
+    struct tilemap* next;
+};
+
+static tilemap* tilemaps;
+static commandList tilemapScratch;
+static tilemapOp* tilemapOps;
+static int tilemapOpCapacity;
+
+tilemap* tilemapCreate(texture tileset, int tileWidth, int tileHeight, int columns, int rows) {
+    textureInfo* info = textureInfoGet(tileset);
+
+    if (!info || tileWidth <= 0 || tileHeight <= 0 || columns <= 0 || rows <= 0 || info->width < tileWidth || info->height < tileHeight) {
+        return NULL;
+    }
+
+    tilemap* m = memoryCalloc(MEMORY_RENDER, 1, sizeof(tilemap));
+
+    if (!m) {
+        return NULL;
+    }
+
+    m->tileset = tileset;
+    m->tileWidth = tileWidth;
+    m->tileHeight = tileHeight;
+    m->tilesetColumns = info->width / tileWidth;
+    m->tilesetTiles = m->tilesetColumns * (info->height / tileHeight);
+    m->tilesetWidth = info->width;
+    m->tilesetHeight = info->height;
+    m->direct = rasterMode || !SDL_RenderTargetSupported(initializedNest->renderer);
+    m->columns = columns;
+    m->rows = rows;
+    m->chunkSize = SDL_clamp(TILEMAP_CHUNK_PIXELS / SDL_max(tileWidth, tileHeight), 1, 64);
+    m->chunkColumns = (columns + m->chunkSize - 1) / m->chunkSize;
+    m->chunkRows = (rows + m->chunkSize - 1) / m->chunkSize;
+    m->cacheSize = SDL_min(TILEMAP_CACHE_SIZE, m->chunkColumns * m->chunkRows);
+    m->tiles = memoryAlloc(MEMORY_RENDER, (size_t)columns * rows * sizeof(Sint32));
+    m->chunks = memoryCalloc(MEMORY_RENDER, (size_t)m->chunkColumns * m->chunkRows, sizeof(tilemapChunk));
+    m->slotChunks = memoryAlloc(MEMORY_RENDER, m->cacheSize * sizeof(int));
+    m->slotTextures = memoryCalloc(MEMORY_RENDER, m->cacheSize, sizeof(SDL_Texture*));
+
+    if (!m->tiles || !m->chunks || !m->slotChunks || !m->slotTextures) {
+        memoryFree(m->tiles);
+        memoryFree(m->chunks);
+        memoryFree(m->slotChunks);
+        memoryFree(m->slotTextures);
+        memoryFree(m);
+        return NULL;
+    }
+
+    for (int i = 0; i < columns * rows; i++) {
+        m->tiles[i] = -1;
+    }
+
+    for (int i = 0; i < m->chunkColumns * m->chunkRows; i++) {
+        m->chunks[i].slot = -1;
+    }
+
+    for (int i = 0; i < m->cacheSize; i++) {
+        m->slotChunks[i] = -1;
+    }
+
+    m->next = tilemaps;
+    tilemaps = m;
+
+    return m;
+}
+
+static void tilemapRelease(void* data) {
+    tilemap* m = data;
+
+    for (int i = 0; i < m->cacheSize; i++) {
+        if (m->slotTextures[i]) {
+            memoryDestroyTexture(m->slotTextures[i]);
+        }
+    }
+
+    memoryFree(m->tiles);
+    memoryFree(m->chunks);
+    memoryFree(m->slotChunks);
+    memoryFree(m->slotTextures);
+    memoryFree(m);
+}
+
+void tilemapDestroy(tilemap* m) {
+    if (!m) {
+        return;
+    }
+
+    for (tilemap** it = &tilemaps; *it; it = &(*it)->next) {
+        if (*it == m) {
+            *it = m->next;
+            break;
+        }
+    }
+
+    renderRelease(tilemapRelease, m);
+}
+
+void tilemapSetTile(tilemap* m, int x, int y, int tile) {
+    if (!m || x < 0 || y < 0 || x >= m->columns || y >= m->rows) {
+        return;
+    }
+
+    Sint32* t = &m->tiles[y * m->columns + x];
+
+    if (*t != tile) {
+        *t = tile;
+        m->chunks[(y / m->chunkSize) * m->chunkColumns + x / m->chunkSize].dirty = TRUE;
+        m->version++;
+    }
+}
+
+int tilemapGetTile(tilemap* m, int x, int y) {
+    if (!m || x < 0 || y < 0 || x >= m->columns || y >= m->rows) {
+        return -1;
+    }
+
+    return m->tiles[y * m->columns + x];
+}
+
+static int tilemapAcquireSlot(tilemap* m) {
+    int best = -1;
+    Uint32 oldest = 0;
+
+    for (int i = 0; i < m->cacheSize; i++) {
+        int chunk = m->slotChunks[i];
+
+        if (chunk < 0) {
+            return i;
+        }
+
+        Uint32 age = m->frame - m->chunks[chunk].lastUsed;
+
+        if (age > 0 && (best < 0 || age > oldest)) {
+            best = i;
+            oldest = age;
+        }
+    }
+
+    if (best >= 0) {
+        m->chunks[m->slotChunks[best]].slot = -1;
+    }
+
+    return best;
+}
+
+static size_t tilemapCopyChunk(tilemap* m, commandList* list, int chunk) {
+    int size = m->chunkSize;
+    size_t offset = commandData(list, NULL, (size_t)size * size * sizeof(Sint32));
+
+    if (offset == (size_t)-1) {
+        return offset;
+    }
+
+    Sint32* out = (Sint32*)(list->data + offset);
+    int x0 = (chunk % m->chunkColumns) * size;
+    int y0 = (chunk / m->chunkColumns) * size;
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            out[y * size + x] = (x0 + x < m->columns && y0 + y < m->rows) ? m->tiles[(y0 + y) * m->columns + x0 + x] : -1;
+        }
+    }
+
+    return offset;
+}
+
+static int tilemapPlan(tilemap* m, vector2 offset, SDL_Rect screen, commandList* list, size_t* first) {
+    int chunkWidth = m->chunkSize * m->tileWidth;
+    int chunkHeight = m->chunkSize * m->tileHeight;
+    int cx0 = SDL_max((int)floorf((screen.x - offset.x) / chunkWidth), 0);
+    int cy0 = SDL_max((int)floorf((screen.y - offset.y) / chunkHeight), 0);
+    int cx1 = SDL_min((int)floorf((screen.x + screen.w - offset.x) / chunkWidth), m->chunkColumns - 1);
+    int cy1 = SDL_min((int)floorf((screen.y + screen.h - offset.y) / chunkHeight), m->chunkRows - 1);
+    bool direct = m->direct || SDL_AtomicGet(&layerBakeUnsupported);
+    int count = 0;
+
+    m->frame++;
+
+    if (SDL_AtomicSet(&m->lost, 0)) {
+        for (int i = 0; i < m->cacheSize; i++) {
+            if (m->slotChunks[i] >= 0) {
+                m->chunks[m->slotChunks[i]].slot = -1;
+                m->slotChunks[i] = -1;
+            }
+        }
+    }
+
+    *first = (size_t)-1;
+
+    int visible = SDL_max(cx1 - cx0 + 1, 0) * SDL_max(cy1 - cy0 + 1, 0);
+
+    if (visible > tilemapOpCapacity) {
+        tilemapOp* ops = memoryRealloc(MEMORY_RENDER, tilemapOps, visible * sizeof(tilemapOp));
+
+        if (!ops) {
+            return 0;
+        }
+
+        tilemapOps = ops;
+        tilemapOpCapacity = visible;
+    }
+
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            int index = cy * m->chunkColumns + cx;
+            tilemapChunk* chunk = &m->chunks[index];
+            tilemapOp* op = &tilemapOps[count];
+
+            chunk->lastUsed = m->frame;
+
+            if (!direct && chunk->slot < 0) {
+                chunk->slot = tilemapAcquireSlot(m);
+
+                if (chunk->slot >= 0) {
+                    m->slotChunks[chunk->slot] = index;
+                    chunk->dirty = TRUE;
+                }
+            }
+
+            // More chunks on screen than cache slots: draw the rest as tiles.
+            bool uncached = direct || chunk->slot < 0;
+
+            op->chunk = index;
+            op->slot = uncached ? -1 : chunk->slot;
+            op->tiles = (size_t)-1;
+
+            if (uncached || chunk->dirty) {
+                op->tiles = tilemapCopyChunk(m, list, index);
+
+                if (op->tiles == (size_t)-1) {
+                    continue;
+                }
+            }
+
+            chunk->dirty = FALSE;
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        *first = commandData(list, tilemapOps, count * sizeof(tilemapOp));
+    }
+
+    return *first != (size_t)-1 ? count : 0;
+}
+
+static void tilemapEmitTiles(tilemap* m, const Sint32* tiles, float x, float y) {
+    SDL_Color white = { 255, 255, 255, 255 };
+    float tw = (float)m->tileWidth;
+    float th = (float)m->tileHeight;
+    float iw = 1.0f / m->tilesetWidth;
+    float ih = 1.0f / m->tilesetHeight;
+
+    for (int ty = 0; ty < m->chunkSize; ty++) {
+        for (int tx = 0; tx < m->chunkSize; tx++) {
+            Sint32 tile = tiles[ty * m->chunkSize + tx];
+
+            if (tile < 0 || tile >= m->tilesetTiles || !geometryBegin(m->tileset, 4, 6)) {
+                continue;
+            }
+
+            float u0 = (tile % m->tilesetColumns) * tw * iw;
+            float v0 = (tile / m->tilesetColumns) * th * ih;
+            float u1 = u0 + tw * iw;
+            float v1 = v0 + th * ih;
+            float px = x + tx * tw;
+            float py = y + ty * th;
+
+            int a = geometryVertexUV(px, py, white, u0, v0);
+            int b = geometryVertexUV(px + tw, py, white, u1, v0);
+            int c = geometryVertexUV(px + tw, py + th, white, u1, v1);
+            int d = geometryVertexUV(px, py + th, white, u0, v1);
+            geometryQuad(a, b, c, d);
+        }
+    }
+}
+
+static void renderTilemap(tilemap* m, vector2 offset, const Uint8* data, size_t first, int count) {
+    SDL_Renderer* r = initializedNest->renderer;
+    int chunkWidth = m->chunkSize * m->tileWidth;
+    int chunkHeight = m->chunkSize * m->tileHeight;
+    const tilemapOp* ops = (const tilemapOp*)(data + first);
+
+    for (int i = 0; i < count; i++) {
+        const tilemapOp* op = &ops[i];
+        float x = offset.x + (op->chunk % m->chunkColumns) * chunkWidth;
+        float y = offset.y + (op->chunk / m->chunkColumns) * chunkHeight;
+
+        if (op->slot < 0) {
+            tilemapEmitTiles(m, (const Sint32*)(data + op->tiles), x, y);
+            continue;
+        }
+
+        SDL_Texture** slot = &m->slotTextures[op->slot];
+
+        if (op->tiles != (size_t)-1) {
+            if (!*slot) {
+                *slot = memoryTexture(SDL_CreateTexture(r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, chunkWidth, chunkHeight));
+
+                if (!*slot) {
+                    SDL_AtomicSet(&m->lost, 1);
+                    continue;
+                }
+
+                if (SDL_SetTextureBlendMode(*slot, layerCompositeMode(BLEND_ALPHA)) != 0) {
+                    memoryDestroyTexture(*slot);
+                    *slot = NULL;
+                    SDL_AtomicSet(&layerBakeUnsupported, 1);
+                    SDL_AtomicSet(&m->lost, 1);
+                    tilemapEmitTiles(m, (const Sint32*)(data + op->tiles), x, y);
+                    continue;
+                }
+            }
+
+            // Baked like a layer: always alpha over transparent black, which
+            // leaves the chunk premultiplied whatever mode the game has set.
+            blendMode blend = geometryBlend;
+            geometryFlush();
+            geometryBlend = BLEND_ALPHA;
+
+            SDL_Texture* previous = SDL_GetRenderTarget(r);
+            SDL_SetRenderTarget(r, *slot);
+            SDL_SetRenderDrawColor(r, 0, 0, 0, 0);
+            SDL_RenderClear(r);
+            tilemapEmitTiles(m, (const Sint32*)(data + op->tiles), 0, 0);
+            geometryFlush();
+            SDL_SetRenderTarget(r, previous);
+            geometryBlend = blend;
+        }
+        else if (!*slot) {
+            SDL_AtomicSet(&m->lost, 1);
+            continue;
+        }
+
+        SDL_Rect dst = { (int)x, (int)y, chunkWidth, chunkHeight };
+        geometryFlush();
+        SDL_SetTextureBlendMode(*slot, layerCompositeMode(geometryBlend));
+        SDL_RenderCopy(r, *slot, NULL, &dst);
+    }
+}
+
+void drawTilemap(tilemap* m, vector2 offset) {
+    if (!m || commandTilemap(m, offset)) {
+        return;
+    }
+
+    SDL_Rect screen = { 0, 0, 0, 0 };
+    size_t first;
+
+    SDL_GetRendererOutputSize(initializedNest->renderer, &screen.w, &screen.h);
+    tilemapScratch.dataSize = 0;
+
+    int count = tilemapPlan(m, offset, screen, &tilemapScratch, &first);
+    renderTilemap(m, offset, tilemapScratch.data, first, count);
+}
+
+static Uint32 tilemapVersion(tilemap* m) {
+    return m->version;
+}
+
+static void tilemapsInvalidate(bool deviceLost) {
+    for (tilemap* m = tilemaps; m; m = m->next) {
+        if (deviceLost) {
+            for (int i = 0; i < m->cacheSize; i++) {
+                if (m->slotTextures[i]) {
+                    memoryDestroyTexture(m->slotTextures[i]);
+                    m->slotTextures[i] = NULL;
+                }
+            }
+        }
+
+        SDL_AtomicSet(&m->lost, 1);
+    }
+}
+
+static void tilemapsFree(void) {
+    while (tilemaps) {
+        tilemap* m = tilemaps;
+        tilemaps = m->next;
+        tilemapRelease(m);
+    }
+
+    memoryFree(tilemapScratch.data);
+    memoryFree(tilemapOps);
+    SDL_zero(tilemapScratch);
+    tilemapOps = NULL;
+    tilemapOpCapacity = 0;
+}
+
+// Text
+
+#define FONT_MAX_PAGES 4
+#define TEXT_CACHE_SIZE 256
+#define TEXT_CACHE_PROBE 4
+
+typedef struct fontGlyph {
+    Uint32 id;
+    Sint16 x;
+    Sint16 y;
+    Sint16 width;
+    Sint16 height;
+    Sint16 xoffset;
+    Sint16 yoffset;
+    Sint16 xadvance;
+    Uint8 page;
+} fontGlyph;
+
+typedef struct fontKerning {
+    Uint32 pair;
+    Sint16 amount;
+} fontKerning;
+
+struct font {
+    texture pages[FONT_MAX_PAGES];
+    int pageCount;
+    int lineHeight;
+    int scaleWidth;
+    int scaleHeight;
+    fontGlyph* glyphs;
+    int glyphCount;
+    int ascii[256];
+    fontKerning* kernings;
+    int kerningCount;
+};
+
+struct textGlyph {
+    float x;
+    float y;
+    float width;
+    float height;
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+    int page;
+};
+
+typedef struct textLayout {
+    Uint64 hash;
+    font* font;
+    char* text;
+    size_t textCapacity;
+    textGlyph* glyphs;
+    int count;
+    int capacity;
+    vector2 size;
+    Uint32 lastUsed;
+} textLayout;
+
+typedef struct textBatch {
+    texture tex;
+    SDL_Vertex* vertices;
+    int vertexCount;
+    int vertexCapacity;
+    int* indices;
+    int indexCount;
+    int indexCapacity;
+} textBatch;
+
+static const Uint8 fontDefaultBits[95 * 7] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04,
+    0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a,
+    0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04, 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03,
+    0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08,
+    0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00, 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00,
+    0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e, 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e,
+    0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f, 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e,
+    0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02, 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e,
+    0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e, 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08,
+    0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e, 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c,
+    0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00, 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08,
+    0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00,
+    0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04,
+    0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e, 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11,
+    0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e, 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e,
+    0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c, 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f,
+    0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10, 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f,
+    0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e,
+    0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c, 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f, 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,
+    0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10, 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d,
+    0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11, 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e,
+    0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,
+    0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a,
+    0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04,
+    0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f, 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e,
+    0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e,
+    0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f,
+    0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f,
+    0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e, 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e,
+    0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f, 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e,
+    0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08, 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e,
+    0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e,
+    0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c, 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12,
+    0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11,
+    0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e,
+    0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10, 0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01,
+    0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e,
+    0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06, 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d,
+    0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a,
+    0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e,
+    0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f, 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02,
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08,
+    0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00
+};
+
+static font* defaultFont;
+static textLayout textCache[TEXT_CACHE_SIZE];
+static Uint32 textClock;
+static textBatch* textBatches;
+static int textBatchCount;
+
+static int fontCompareGlyph(const void* a, const void* b) {
+    Uint32 x = ((const fontGlyph*)a)->id;
+    Uint32 y = ((const fontGlyph*)b)->id;
+    return (x > y) - (x < y);
+}
+
+static int fontCompareKerning(const void* a, const void* b) {
+    Uint32 x = ((const fontKerning*)a)->pair;
+    Uint32 y = ((const fontKerning*)b)->pair;
+    return (x > y) - (x < y);
+}
+
+static void fontIndex(font* f) {
+    qsort(f->glyphs, f->glyphCount, sizeof(fontGlyph), fontCompareGlyph);
+    qsort(f->kernings, f->kerningCount, sizeof(fontKerning), fontCompareKerning);
+
+    for (int i = 0; i < 256; i++) {
+        f->ascii[i] = -1;
+    }
+
+    for (int i = 0; i < f->glyphCount; i++) {
+        if (f->glyphs[i].id < 256) {
+            f->ascii[f->glyphs[i].id] = i;
+        }
+    }
+}
+
+static const fontGlyph* fontFindGlyph(font* f, Uint32 id) {
+    if (id < 256) {
+        return f->ascii[id] >= 0 ? &f->glyphs[f->ascii[id]] : NULL;
+    }
+
+    fontGlyph key;
+    key.id = id;
+
+    return bsearch(&key, f->glyphs, f->glyphCount, sizeof(fontGlyph), fontCompareGlyph);
+}
+
+static int fontFindKerning(font* f, Uint32 first, Uint32 second) {
+    if (f->kerningCount == 0 || first > 0xFFFF || second > 0xFFFF) {
+        return 0;
+    }
+
+    fontKerning key;
+    key.pair = (first << 16) | second;
+
+    fontKerning* k = bsearch(&key, f->kernings, f->kerningCount, sizeof(fontKerning), fontCompareKerning);
+
+    return k ? k->amount : 0;
+}
+
+static int fontValue(const char* line, const char* key) {
+    const char* at = line;
+    size_t length = strlen(key);
+
+    while ((at = strstr(at, key)) != NULL) {
+        if ((at == line || at[-1] == ' ') && at[length] == '=') {
+            return atoi(at + length + 1);
+        }
+
+        at += length;
+    }
+
+    return 0;
+}
+
+font* fontLoad(const char* path) {
+    FILE* file = fopen(path, "r");
+    char line[512];
+    int glyphCapacity = 0;
+    int kerningCapacity = 0;
+
+    if (!file) {
+        return NULL;
+    }
+
+    font* f = memoryCalloc(MEMORY_TEXT, 1, sizeof(font));
+
+    if (!f) {
+        fclose(file);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "common ", 7) == 0) {
+            f->lineHeight = fontValue(line, "lineHeight");
+            f->scaleWidth = fontValue(line, "scaleW");
+            f->scaleHeight = fontValue(line, "scaleH");
+        }
+        else if (strncmp(line, "page ", 5) == 0) {
+            int id = fontValue(line, "id");
+            char* name = strstr(line, "file=\"");
+            char* end = name ? strchr(name + 6, '"') : NULL;
+
+            if (id < 0 || id >= FONT_MAX_PAGES || !end) {
+                continue;
+            }
+
+            const char* slash = strrchr(path, '/');
+            const char* backslash = strrchr(path, '\\');
+            size_t dir = slash || backslash ? (size_t)(SDL_max(slash, backslash) - path + 1) : 0;
+            char pagePath[1024];
+
+            *end = '\0';
+            SDL_snprintf(pagePath, sizeof(pagePath), "%.*s%s", (int)dir, path, name + 6);
+
+            f->pages[id] = textureLoad(pagePath);
+            f->pageCount = SDL_max(f->pageCount, id + 1);
+        }
+        else if (strncmp(line, "char ", 5) == 0) {
+            if (f->glyphCount == glyphCapacity) {
+                glyphCapacity = glyphCapacity ? glyphCapacity * 2 : 128;
+                fontGlyph* glyphs = memoryRealloc(MEMORY_TEXT, f->glyphs, glyphCapacity * sizeof(fontGlyph));
+
+                if (!glyphs) {
+                    break;
+                }
+
+                f->glyphs = glyphs;
+            }
+
+            fontGlyph* g = &f->glyphs[f->glyphCount++];
+            g->id = (Uint32)fontValue(line, "id");
+            g->x = (Sint16)fontValue(line, "x");
+            g->y = (Sint16)fontValue(line, "y");
+            g->width = (Sint16)fontValue(line, "width");
+            g->height = (Sint16)fontValue(line, "height");
+            g->xoffset = (Sint16)fontValue(line, "xoffset");
+            g->yoffset = (Sint16)fontValue(line, "yoffset");
+            g->xadvance = (Sint16)fontValue(line, "xadvance");
+            g->page = (Uint8)SDL_clamp(fontValue(line, "page"), 0, FONT_MAX_PAGES - 1);
+        }
+        else if (strncmp(line, "kerning ", 8) == 0) {
+            if (f->kerningCount == kerningCapacity) {
+                kerningCapacity = kerningCapacity ? kerningCapacity * 2 : 128;
+                fontKerning* kernings = memoryRealloc(MEMORY_TEXT, f->kernings, kerningCapacity * sizeof(fontKerning));
+
+                if (!kernings) {
+                    break;
+                }
+
+                f->kernings = kernings;
+            }
+
+            fontKerning* k = &f->kernings[f->kerningCount++];
+            k->pair = ((Uint32)fontValue(line, "first") << 16) | ((Uint32)fontValue(line, "second") & 0xFFFF);
+            k->amount = (Sint16)fontValue(line, "amount");
+        }
+    }
+
+    fclose(file);
+
+    if (f->pageCount == 0 || !f->pages[0] || f->scaleWidth <= 0 || f->scaleHeight <= 0) {
+        fontDestroy(f);
+        return NULL;
+    }
+
+    fontIndex(f);
+
+    return f;
+}
+
+font* fontDefault(void) {
+    if (defaultFont) {
+        return defaultFont;
+    }
+
+    SDL_Surface* s = memorySurface(SDL_CreateRGBSurfaceWithFormat(0, 16 * 6, 6 * 8, 32, SDL_PIXELFORMAT_RGBA32));
+    font* f = memoryCalloc(MEMORY_TEXT, 1, sizeof(font));
+    fontGlyph* glyphs = memoryCalloc(MEMORY_TEXT, 95, sizeof(fontGlyph));
+
+    if (!s || !f || !glyphs) {
+        memoryFreeSurface(s);
+        memoryFree(f);
+        memoryFree(glyphs);
+        return NULL;
+    }
+
+    SDL_FillRect(s, NULL, 0);
+
+    for (int c = 0; c < 95; c++) {
+        int cx = (c % 16) * 6;
+        int cy = (c / 16) * 8;
+
+        for (int y = 0; y < 7; y++) {
+            Uint32* row = (Uint32*)((Uint8*)s->pixels + (cy + y) * s->pitch) + cx;
+
+            for (int x = 0; x < 5; x++) {
+                if (fontDefaultBits[c * 7 + y] & (0x10 >> x)) {
+                    row[x] = SDL_MapRGBA(s->format, 255, 255, 255, 255);
+                }
+            }
+        }
+
+        glyphs[c].id = 32 + c;
+        glyphs[c].x = (Sint16)cx;
+        glyphs[c].y = (Sint16)cy;
+        glyphs[c].width = c ? 5 : 0;
+        glyphs[c].height = c ? 7 : 0;
+        glyphs[c].xadvance = 6;
+    }
+
+    f->pages[0] = textureFromSurface(s, FALSE);
+    memoryFreeSurface(s);
+
+    if (!f->pages[0]) {
+        memoryFree(f);
+        memoryFree(glyphs);
+        return NULL;
+    }
+
+    f->pageCount = 1;
+    f->lineHeight = 8;
+    f->scaleWidth = 16 * 6;
+    f->scaleHeight = 6 * 8;
+    f->glyphs = glyphs;
+    f->glyphCount = 95;
+    fontIndex(f);
+
+    defaultFont = f;
+
+    return f;
+}
+
+static void fontRelease(void* data) {
+    font* f = data;
+
+    for (int i = 0; i < f->pageCount; i++) {
+        if (f->pages[i]) {
+            textureDestroy(f->pages[i]);
+        }
+    }
+
+    memoryFree(f->glyphs);
+    memoryFree(f->kernings);
+    memoryFree(f);
+}
+
+void fontDestroy(font* f) {
+    if (!f) {
+        return;
+    }
+
+    for (int i = 0; i < TEXT_CACHE_SIZE; i++) {
+        if (textCache[i].font == f) {
+            textCache[i].font = NULL;
+            textCache[i].hash = 0;
+        }
+    }
+
+    for (int i = 0; i < f->pageCount; i++) {
+        textureInfoForget(f->pages[i]);
+    }
+
+    if (f == defaultFont) {
+        defaultFont = NULL;
+    }
+
+    renderRelease(fontRelease, f);
+}
+
+static Uint32 textDecode(const char** text) {
+    const Uint8* s = (const Uint8*)*text;
+    Uint32 c = s[0];
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+
+    if (extra) {
+        c &= 0x3F >> extra;
+
+        for (int i = 1; i <= extra; i++) {
+            if ((s[i] & 0xC0) != 0x80) {
+                *text += i;
+                return 0xFFFD;
+            }
+
+            c = (c << 6) | (s[i] & 0x3F);
+        }
+    }
+
+    *text += extra + 1;
+
+    return c;
+}
+
+static bool textShape(textLayout* layout, font* f, const char* text) {
+    const char* at = text;
+    float x = 0;
+    float y = 0;
+    Uint32 previous = 0;
+
+    layout->count = 0;
+    layout->size = vectorZero();
+
+    while (*at) {
+        Uint32 c = textDecode(&at);
+
+        if (c == '\n') {
+            layout->size.x = SDL_max(layout->size.x, x);
+            x = 0;
+            y += f->lineHeight;
+            previous = 0;
+            continue;
+        }
+
+        const fontGlyph* g = fontFindGlyph(f, c);
+
+        if (!g) {
+            g = fontFindGlyph(f, '?');
+
+            if (!g) {
+                continue;
+            }
+        }
+
+        x += fontFindKerning(f, previous, c);
+        previous = c;
+
+        if (g->width > 0 && g->height > 0) {
+            if (layout->count == layout->capacity) {
+                int capacity = layout->capacity ? layout->capacity * 2 : 32;
+                textGlyph* glyphs = memoryRealloc(MEMORY_TEXT, layout->glyphs, capacity * sizeof(textGlyph));
+
+                if (!glyphs) {
+                    return FALSE;
+                }
+
+                layout->glyphs = glyphs;
+                layout->capacity = capacity;
+            }
+
+            textGlyph* out = &layout->glyphs[layout->count++];
+            out->x = x + g->xoffset;
+            out->y = y + g->yoffset;
+            out->width = g->width;
+            out->height = g->height;
+            out->u0 = (float)g->x / f->scaleWidth;
+            out->v0 = (float)g->y / f->scaleHeight;
+            out->u1 = (float)(g->x + g->width) / f->scaleWidth;
+            out->v1 = (float)(g->y + g->height) / f->scaleHeight;
+            out->page = g->page;
+        }
+
+        x += g->xadvance;
+    }
+
+    layout->size.x = SDL_max(layout->size.x, x);
+    layout->size.y = y + f->lineHeight;
+
+    return TRUE;
+}
+
+static textLayout* textLayoutGet(font* f, const char* text) {
+    Uint64 hash = 14695981039346656037ull ^ (Uint64)(uintptr_t)f;
+    textLayout* victim = NULL;
+
+    for (const Uint8* at = (const Uint8*)text; *at; at++) {
+        hash = (hash ^ *at) * 1099511628211ull;
+    }
+
+    for (int i = 0; i < TEXT_CACHE_PROBE; i++) {
+        textLayout* slot = &textCache[(hash + i) & (TEXT_CACHE_SIZE - 1)];
+
+        if (slot->font == f && slot->hash == hash && strcmp(slot->text, text) == 0) {
+            slot->lastUsed = ++textClock;
+            return slot;
+        }
+
+        if (!victim || !slot->font || (victim->font && slot->lastUsed < victim->lastUsed)) {
+            victim = slot;
+        }
+    }
+
+    size_t length = strlen(text) + 1;
+    victim->font = NULL;
+
+    // Slots keep their text buffer, so changing strings reuse it once it fits.
+    if (length > victim->textCapacity) {
+        size_t capacity = SDL_max(length, victim->textCapacity * 2);
+        char* stored = memoryRealloc(MEMORY_TEXT, victim->text, capacity);
+
+        if (!stored) {
+            return NULL;
+        }
+
+        victim->text = stored;
+        victim->textCapacity = capacity;
+    }
+
+    memcpy(victim->text, text, length);
+
+    if (!textShape(victim, f, text)) {
+        return NULL;
+    }
+
+    victim->font = f;
+    victim->hash = hash;
+    victim->lastUsed = ++textClock;
+
+    return victim;
+}
+
+vector2 textMeasure(font* f, const char* text, float scale) {
+    textLayout* layout = (f && text) ? textLayoutGet(f, text) : NULL;
+
+    if (!layout) {
+        return vectorZero();
+    }
+
+    return (vector2){ layout->size.x * scale, layout->size.y * scale };
+}
+
+static size_t textStore(commandList* list, const textGlyph* glyphs, int count) {
+    return commandData(list, glyphs, count * sizeof(textGlyph));
+}
+
+static textBatch* textBatchFor(texture t) {
+    for (int i = 0; i < textBatchCount; i++) {
+        if (textBatches[i].tex == t) {
+            return &textBatches[i];
+        }
+    }
+
+    textBatch* batches = memoryRealloc(MEMORY_TEXT, textBatches, (textBatchCount + 1) * sizeof(textBatch));
+
+    if (!batches) {
+        return NULL;
+    }
+
+    textBatches = batches;
+
+    textBatch* b = &textBatches[textBatchCount++];
+    SDL_zerop(b);
+    b->tex = t;
+
+    return b;
+}
+
+static void renderText(const font* f, const textGlyph* glyphs, int count, vector2 position, float scale, SDL_Color c) {
+    textBatch* batch = NULL;
+    int page = -1;
+
+    for (int i = 0; i < count; i++) {
+        const textGlyph* g = &glyphs[i];
+
+        if (g->page != page) {
+            page = g->page;
+            batch = f->pages[page] ? textBatchFor(f->pages[page]) : NULL;
+        }
+
+        if (!batch) {
+            continue;
+        }
+
+        if (batch->vertexCount + 4 > batch->vertexCapacity) {
+            int capacity = batch->vertexCapacity ? batch->vertexCapacity * 2 : 1024;
+            SDL_Vertex* vertices = memoryRealloc(MEMORY_TEXT, batch->vertices, capacity * sizeof(SDL_Vertex));
+            int* indices = memoryRealloc(MEMORY_TEXT, batch->indices, capacity / 4 * 6 * sizeof(int));
+
+            if (vertices) {
+                batch->vertices = vertices;
+            }
+
+            if (indices) {
+                batch->indices = indices;
+            }
+
+            if (!vertices || !indices) {
+                continue;
+            }
+
+            batch->vertexCapacity = capacity;
+            batch->indexCapacity = capacity / 4 * 6;
+        }
+
+        float x0 = position.x + g->x * scale;
+        float y0 = position.y + g->y * scale;
+        float x1 = x0 + g->width * scale;
+        float y1 = y0 + g->height * scale;
+        SDL_Vertex* v = &batch->vertices[batch->vertexCount];
+        int* index = &batch->indices[batch->indexCount];
+        int base = batch->vertexCount;
+
+        v[0] = (SDL_Vertex){ { x0, y0 }, c, { g->u0, g->v0 } };
+        v[1] = (SDL_Vertex){ { x1, y0 }, c, { g->u1, g->v0 } };
+        v[2] = (SDL_Vertex){ { x1, y1 }, c, { g->u1, g->v1 } };
+        v[3] = (SDL_Vertex){ { x0, y1 }, c, { g->u0, g->v1 } };
+
+        index[0] = base;
+        index[1] = base + 1;
+        index[2] = base + 2;
+        index[3] = base;
+        index[4] = base + 2;
+        index[5] = base + 3;
+
+        batch->vertexCount += 4;
+        batch->indexCount += 6;
+    }
+}
+
+static void textBatchFlush(void) {
+    for (int i = 0; i < textBatchCount; i++) {
+        textBatch* b = &textBatches[i];
+
+        if (b->indexCount > 0) {
+            geometrySubmit(b->tex, b->vertices, b->vertexCount, b->indices, b->indexCount);
+        }
+
+        b->vertexCount = 0;
+        b->indexCount = 0;
+    }
+}
+
+void drawText(font* f, const char* text, vector2 position, float scale, color color) {
+    if (!f || !text || !*text) {
+        return;
+    }
+
+    textLayout* layout = textLayoutGet(f, text);
+
+    if (!layout || commandText(f, layout->glyphs, layout->count, layout->hash, layout->size, position, scale, color)) {
+        return;
+    }
+
+    renderText(f, layout->glyphs, layout->count, position, scale, colorSDL(color));
+}
+
+static void textsFree(void) {
+    for (int i = 0; i < TEXT_CACHE_SIZE; i++) {
+        memoryFree(textCache[i].text);
+        memoryFree(textCache[i].glyphs);
+    }
+
+    SDL_zeroa(textCache);
+
+    for (int i = 0; i < textBatchCount; i++) {
+        memoryFree(textBatches[i].vertices);
+        memoryFree(textBatches[i].indices);
+    }
+
+    memoryFree(textBatches);
+    textBatches = NULL;
+    textBatchCount = 0;
+
+    if (defaultFont) {
+        fontRelease(defaultFont);
+        defaultFont = NULL;
+    }
+}
+
+// Handles
+
+#define HANDLE_INDEX_BITS 16
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_MAX_COLUMNS 12
+#define HANDLE_COLUMN(array) { (void**)&(array), sizeof(*(array)) }
+
+typedef struct handleColumn {
+    void** array;
+    size_t size;
+} handleColumn;
+
+// Items are packed densely across the column arrays; a handle holds a slot
+// index and generation so a stale handle never reaches a reused slot.
+typedef struct handlePool {
+    handleColumn columns[HANDLE_MAX_COLUMNS];
+    Uint32* owners;
+    int* dense;
+    Uint16* generations;
+    Uint32* freeSlots;
+    int count;
+    int capacity;
+    int slotCount;
+    int freeCount;
+} handlePool;
+
+static bool handleResize(void** array, size_t size, int capacity) {
+    void* grown = memoryRealloc(MEMORY_ANIMATION, *array, capacity * size);
+
+    if (!grown) {
+        return FALSE;
+    }
+
+    *array = grown;
+
+    return TRUE;
+}
+
+static bool handleGrow(handlePool* p) {
+    int capacity = p->capacity ? p->capacity * 2 : 64;
+
+    for (handleColumn* c = p->columns; c->array; c++) {
+        if (!handleResize(c->array, c->size, capacity)) {
+            return FALSE;
+        }
+    }
+
+    if (!handleResize((void**)&p->owners, sizeof(*p->owners), capacity) ||
+        !handleResize((void**)&p->dense, sizeof(*p->dense), capacity) ||
+        !handleResize((void**)&p->generations, sizeof(*p->generations), capacity) ||
+        !handleResize((void**)&p->freeSlots, sizeof(*p->freeSlots), capacity)) {
+        return FALSE;
+    }
+
+    memset(p->generations + p->capacity, 0, (capacity - p->capacity) * sizeof(*p->generations));
+    p->capacity = capacity;
+
+    return TRUE;
+}
+
+static int handleIndex(const handlePool* p, Uint32 h) {
+    Uint32 slot = (h & HANDLE_INDEX_MASK) - 1;
+
+    if (h == 0 || slot >= (Uint32)p->slotCount || p->generations[slot] != (h >> HANDLE_INDEX_BITS)) {
+        return -1;
+    }
+
+    return p->dense[slot];
+}
+
+static Uint32 handleAcquire(handlePool* p, int* index) {
+    if (p->freeCount == 0 && (p->slotCount >= (int)HANDLE_INDEX_MASK || (p->count == p->capacity && !handleGrow(p)))) {
+        return 0;
+    }
+
+    Uint32 slot = p->freeCount > 0 ? p->freeSlots[--p->freeCount] : (Uint32)p->slotCount++;
+
+    *index = p->count++;
+    p->owners[*index] = slot;
+    p->dense[slot] = *index;
+
+    return ((Uint32)p->generations[slot] << HANDLE_INDEX_BITS) | (slot + 1);
+}
+
+static void handleRemove(handlePool* p, int i) {
+    Uint32 slot = p->owners[i];
+    int last = --p->count;
+
+    for (handleColumn* c = p->columns; c->array; c++) {
+        memmove((Uint8*)*c->array + i * c->size, (Uint8*)*c->array + last * c->size, c->size);
+    }
+
+    p->owners[i] = p->owners[last];
+    p->dense[p->owners[i]] = i;
+
+    p->dense[slot] = -1;
+    p->generations[slot]++;
+    p->freeSlots[p->freeCount++] = slot;
+}
+
+static void handlePoolFree(handlePool* p) {
+    for (handleColumn* c = p->columns; c->array; c++) {
+        memoryFree(*c->array);
+        *c->array = NULL;
+    }
+
+    memoryFree(p->owners);
+    memoryFree(p->dense);
+    memoryFree(p->generations);
+    memoryFree(p->freeSlots);
+    p->owners = NULL;
+    p->dense = NULL;
+    p->generations = NULL;
+    p->freeSlots = NULL;
+    p->count = p->capacity = 0;
+    p->slotCount = p->freeCount = 0;
+}
+
+// Animations
+
+struct animationClip {
+    texture sheet;
+    SDL_Rect* frames;
+    int count;
+    float fps;
+};
+
+static animationClip** animationClips;
+static float* animationTimes;
+static float* animationSpeeds;
+static int* animationFrames;
+static Uint8* animationLoops;
+static Uint8* animationDone;
+
+static handlePool animations = {
+    .columns = {
+        HANDLE_COLUMN(animationClips),
+        HANDLE_COLUMN(animationTimes),
+        HANDLE_COLUMN(animationSpeeds),
+        HANDLE_COLUMN(animationFrames),
+        HANDLE_COLUMN(animationLoops),
+        HANDLE_COLUMN(animationDone)
+    }
+};
+
+animationClip* animationClipCreate(texture sheet, const SDL_Rect* frames, int count, float fps) {
+    if (!sheet || !frames || count <= 0 || fps <= 0) {
+        return NULL;
+    }
+
+    animationClip* c = memoryAlloc(MEMORY_ANIMATION, sizeof(animationClip));
+    SDL_Rect* copy = memoryAlloc(MEMORY_ANIMATION, count * sizeof(SDL_Rect));
+
+    if (!c || !copy) {
+        memoryFree(c);
+        memoryFree(copy);
+        return NULL;
+    }
+
+    memcpy(copy, frames, count * sizeof(SDL_Rect));
+    c->sheet = sheet;
+    c->frames = copy;
+    c->count = count;
+    c->fps = fps;
+
+    return c;
+}
+
+animationClip* animationClipGrid(texture sheet, int frameWidth, int frameHeight, int first, int count, float fps) {
+    textureInfo* info = textureInfoGet(sheet);
+
+    if (!info || frameWidth <= 0 || frameHeight <= 0 || first < 0 || count <= 0) {
+        return NULL;
+    }
+
+    int columns = info->width / frameWidth;
+    int rows = info->height / frameHeight;
+
+    if (columns == 0 || first + count > columns * rows) {
+        return NULL;
+    }
+
+    SDL_Rect* frames = memoryAlloc(MEMORY_ANIMATION, count * sizeof(SDL_Rect));
+
+    if (!frames) {
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int cell = first + i;
+        frames[i] = (SDL_Rect){ (cell % columns) * frameWidth, (cell / columns) * frameHeight, frameWidth, frameHeight };
+    }
+
+    animationClip* c = animationClipCreate(sheet, frames, count, fps);
+    memoryFree(frames);
+
+    return c;
+}
+
+static int animationIndex(animation a) {
+    return handleIndex(&animations, a);
+}
+
+animation animationPlay(animationClip* c, animationLoop loop, float speed) {
+    int i;
+    animation a = c ? handleAcquire(&animations, &i) : 0;
+
+    if (a) {
+        animationClips[i] = c;
+        animationTimes[i] = 0;
+        animationSpeeds[i] = speed;
+        animationFrames[i] = 0;
+        animationLoops[i] = (Uint8)loop;
+        animationDone[i] = FALSE;
+    }
+
+    return a;
+}
+
+void animationStop(animation a) {
+    int i = animationIndex(a);
+
+    if (i >= 0) {
+        handleRemove(&animations, i);
+    }
+}
+
+void animationSetSpeed(animation a, float speed) {
+    int i = animationIndex(a);
+
+    if (i >= 0) {
+        animationSpeeds[i] = speed;
+    }
+}
+
+void animationRestart(animation a) {
+    int i = animationIndex(a);
+
+    if (i >= 0) {
+        animationTimes[i] = 0;
+        animationFrames[i] = 0;
+        animationDone[i] = FALSE;
+    }
+}
+
+bool animationFinished(animation a) {
+    int i = animationIndex(a);
+    return i < 0 || animationDone[i];
+}
+
+SDL_Rect animationFrame(animation a) {
+    int i = animationIndex(a);
+    return i >= 0 ? animationClips[i]->frames[animationFrames[i]] : (SDL_Rect){ 0, 0, 0, 0 };
+}
+
+void animationApply(animation a, sprite* s) {
+    int i = animationIndex(a);
+
+    if (i >= 0 && s) {
+        s->tex = animationClips[i]->sheet;
+        s->source = animationClips[i]->frames[animationFrames[i]];
+    }
+}
+
+static void animationsUpdate(float dt) {
+    for (int i = 0; i < animations.count; i++) {
+        const animationClip* c = animationClips[i];
+        float count = (float)c->count;
+        float t = animationTimes[i] + dt * animationSpeeds[i] * c->fps;
+        int frame;
+
+        switch (animationLoops[i]) {
+            case LOOP_REPEAT:
+                t = fmodf(t, count);
+                t = t < 0 ? t + count : t;
+                frame = (int)t;
+                break;
+
+            case LOOP_PINGPONG: {
+                float period = SDL_max(2 * count - 2, 1.0f);
+                t = fmodf(t, period);
+                t = t < 0 ? t + period : t;
+                frame = t < count ? (int)t : SDL_min((int)period - (int)t, c->count - 1);
+                break;
+            }
+
+            default:
+                t = SDL_clamp(t, 0.0f, count);
+                frame = (int)t;
+                animationDone[i] = t >= count || (t <= 0 && animationSpeeds[i] < 0);
+                break;
+        }
+
+        animationTimes[i] = t;
+        animationFrames[i] = SDL_clamp(frame, 0, c->count - 1);
+    }
+}
+
+void animationClipDestroy(animationClip* c) {
+    if (!c) {
+        return;
+    }
+
+    for (int i = animations.count - 1; i >= 0; i--) {
+        if (animationClips[i] == c) {
+            handleRemove(&animations, i);
+        }
+    }
+
+    memoryFree(c->frames);
+    memoryFree(c);
+}
+
+static void animationsFree(void) {
+    handlePoolFree(&animations);
+}
+
+// Tweens
+
+#define EASE_TABLE_SIZE 256
+
+enum {
+    TWEEN_FLOAT,
+    TWEEN_VECTOR,
+    TWEEN_ANGLE,
+    TWEEN_COLOR
+};
+
+static void** tweenTargets;
+static Uint8* tweenKinds;
+static Uint8* tweenEasings;
+static float* tweenElapsed;
+static float* tweenDurations;
+static float* tweenDelays;
+static float (*tweenStarts)[4];
+static float (*tweenDeltas)[4];
+
+static handlePool tweens = {
+    .columns = {
+        HANDLE_COLUMN(tweenTargets),
+        HANDLE_COLUMN(tweenKinds),
+        HANDLE_COLUMN(tweenEasings),
+        HANDLE_COLUMN(tweenElapsed),
+        HANDLE_COLUMN(tweenDurations),
+        HANDLE_COLUMN(tweenDelays),
+        HANDLE_COLUMN(tweenStarts),
+        HANDLE_COLUMN(tweenDeltas)
+    }
+};
+
+static float easeTable[EASING_COUNT][EASE_TABLE_SIZE + 1];
+static bool easeTableReady;
+
+static float easeBounce(float t) {
+    if (t < 1 / 2.75f) {
+        return 7.5625f * t * t;
+    }
+
+    if (t < 2 / 2.75f) {
+        t -= 1.5f / 2.75f;
+        return 7.5625f * t * t + 0.75f;
+    }
+
+    if (t < 2.5f / 2.75f) {
+        t -= 2.25f / 2.75f;
+        return 7.5625f * t * t + 0.9375f;
+    }
+
+    t -= 2.625f / 2.75f;
+    return 7.5625f * t * t + 0.984375f;
+}
+
+static float easeExact(easing e, float t) {
+    float u = 1 - t;
+
+    switch (e) {
+        case EASE_IN_QUAD:          return t * t;
+        case EASE_OUT_QUAD:         return 1 - u * u;
+        case EASE_IN_OUT_QUAD:      return t < 0.5f ? 2 * t * t : 1 - 2 * u * u;
+        case EASE_IN_CUBIC:         return t * t * t;
+        case EASE_OUT_CUBIC:        return 1 - u * u * u;
+        case EASE_IN_OUT_CUBIC:     return t < 0.5f ? 4 * t * t * t : 1 - 4 * u * u * u;
+        case EASE_IN_SINE:          return 1 - cosf(t * (float)M_PI / 2);
+        case EASE_OUT_SINE:         return sinf(t * (float)M_PI / 2);
+        case EASE_IN_OUT_SINE:      return (1 - cosf(t * (float)M_PI)) / 2;
+        case EASE_IN_EXPO:          return t <= 0 ? 0 : powf(2, 10 * t - 10);
+        case EASE_OUT_EXPO:         return t >= 1 ? 1 : 1 - powf(2, -10 * t);
+        case EASE_IN_BACK:          return t * t * (2.70158f * t - 1.70158f);
+        case EASE_OUT_BACK:         return 1 - u * u * (2.70158f * u - 1.70158f);
+        case EASE_IN_ELASTIC:       return t <= 0 || t >= 1 ? t : -powf(2, 10 * t - 10) * sinf((t * 10 - 10.75f) * 2 * (float)M_PI / 3);
+        case EASE_OUT_ELASTIC:      return t <= 0 || t >= 1 ? t : powf(2, -10 * t) * sinf((t * 10 - 0.75f) * 2 * (float)M_PI / 3) + 1;
+        case EASE_IN_BOUNCE:        return 1 - easeBounce(u);
+        case EASE_OUT_BOUNCE:       return easeBounce(t);
+        default:                    return t;
+    }
+}
+
+// Polynomial curves are cheaper to evaluate than to look up; everything from
+// the sine curves on goes through a table sampled once on first use.
+float ease(easing e, float t) {
+    t = SDL_clamp(t, 0.0f, 1.0f);
+
+    if (e < EASE_IN_SINE || e >= EASING_COUNT) {
+        return easeExact(e, t);
+    }
+
+    if (!easeTableReady) {
+        for (int i = EASE_IN_SINE; i < EASING_COUNT; i++) {
+            for (int j = 0; j <= EASE_TABLE_SIZE; j++) {
+                easeTable[i][j] = easeExact((easing)i, (float)j / EASE_TABLE_SIZE);
+            }
+        }
+
+        easeTableReady = TRUE;
+    }
+
+    float position = t * EASE_TABLE_SIZE;
+    int j = SDL_min((int)position, EASE_TABLE_SIZE - 1);
+
+    return lerpf(easeTable[e][j], easeTable[e][j + 1], position - j);
+}
+
+static int tweenIndex(tween t) {
+    return handleIndex(&tweens, t);
+}
+
+static tween tweenStart(void* target, int kind, const float start[4], const float end[4], float duration, easing e) {
+    int i;
+    tween t = target ? handleAcquire(&tweens, &i) : 0;
+
+    if (!t) {
+        return 0;
+    }
+
+    tweenTargets[i] = target;
+    tweenKinds[i] = (Uint8)kind;
+    tweenEasings[i] = (Uint8)(e < EASING_COUNT ? e : EASE_LINEAR);
+    tweenElapsed[i] = 0;
+    tweenDurations[i] = SDL_max(duration, 0.0f);
+    tweenDelays[i] = 0;
+
+    for (int j = 0; j < 4; j++) {
+        tweenStarts[i][j] = start[j];
+        tweenDeltas[i][j] = end[j] - start[j];
+    }
+
+    return t;
+}
+
+tween tweenFloat(float* target, float to, float duration, easing e) {
+    if (!target) {
+        return 0;
+    }
+
+    float start[4] = { *target, 0, 0, 0 };
+    float end[4] = { to, 0, 0, 0 };
+
+    return tweenStart(target, TWEEN_FLOAT, start, end, duration, e);
+}
+
+tween tweenVector(vector2* target, vector2 to, float duration, easing e) {
+    if (!target) {
+        return 0;
+    }
+
+    float start[4] = { target->x, target->y, 0, 0 };
+    float end[4] = { to.x, to.y, 0, 0 };
+
+    return tweenStart(target, TWEEN_VECTOR, start, end, duration, e);
+}
+
+tween tweenAngle(angle target, float to, float duration, easing e) {
+    if (!target) {
+        return 0;
+    }
+
+    float start[4] = { *target, 0, 0, 0 };
+    float end[4] = { *target + angleShortestDistance(target, &to), 0, 0, 0 };
+
+    return tweenStart(target, TWEEN_ANGLE, start, end, duration, e);
+}
+
+tween tweenColor(color* target, color to, float duration, easing e) {
+    if (!target) {
+        return 0;
+    }
+
+    float start[4] = { target->r, target->g, target->b, target->a };
+    float end[4] = { to.r, to.g, to.b, to.a };
+
+    return tweenStart(target, TWEEN_COLOR, start, end, duration, e);
+}
+
+void tweenDelay(tween t, float delay) {
+    int i = tweenIndex(t);
+
+    if (i >= 0) {
+        tweenDelays[i] = SDL_max(delay, 0.0f);
+    }
+}
+
+void tweenCancel(tween t) {
+    int i = tweenIndex(t);
+
+    if (i >= 0) {
+        handleRemove(&tweens, i);
+    }
+}
+
+void tweenCancelTarget(void* target) {
+    for (int i = tweens.count - 1; i >= 0; i--) {
+        if (tweenTargets[i] == target) {
+            handleRemove(&tweens, i);
+        }
+    }
+}
+
+bool tweenActive(tween t) {
+    return tweenIndex(t) >= 0;
+}
+
+static Uint8 tweenChannel(float value) {
+    return (Uint8)SDL_clamp(value + 0.5f, 0.0f, 255.0f);
+}
+
+static void tweensUpdate(float dt) {
+    for (int i = tweens.count - 1; i >= 0; i--) {
+        float step = dt;
+
+        if (tweenDelays[i] > 0) {
+            tweenDelays[i] -= step;
+
+            if (tweenDelays[i] > 0) {
+                continue;
+            }
+
+            step = -tweenDelays[i];
+            tweenDelays[i] = 0;
+        }
+
+        tweenElapsed[i] += step;
+
+        bool done = tweenElapsed[i] >= tweenDurations[i];
+        float k = done ? 1.0f : ease((easing)tweenEasings[i], tweenElapsed[i] / tweenDurations[i]);
+        const float* s = tweenStarts[i];
+        const float* d = tweenDeltas[i];
+
+        switch (tweenKinds[i]) {
+            case TWEEN_VECTOR: {
+                vector2* v = tweenTargets[i];
+                v->x = s[0] + d[0] * k;
+                v->y = s[1] + d[1] * k;
+                break;
+            }
+
+            case TWEEN_COLOR: {
+                color* c = tweenTargets[i];
+                c->r = tweenChannel(s[0] + d[0] * k);
+                c->g = tweenChannel(s[1] + d[1] * k);
+                c->b = tweenChannel(s[2] + d[2] * k);
+                c->a = tweenChannel(s[3] + d[3] * k);
+                break;
+            }
+
+            default:
+                *(float*)tweenTargets[i] = s[0] + d[0] * k;
+                break;
+        }
+
+        if (done) {
+            handleRemove(&tweens, i);
+        }
+    }
+}
+
+static void tweensFree(void) {
+    handlePoolFree(&tweens);
+}
+
+// Collision
+
+// Gravity
+
+// Camera
+
+// Input
+
+#define INPUT_MAX_PADS 4
+#define INPUT_MAX_ACTIONS 64
+#define INPUT_MAX_BINDINGS 8
+#define INPUT_KEY_WORDS (SDL_NUM_SCANCODES / 64)
+
+typedef struct inputBinding {
+    Uint8 device;
+    Sint8 pad;
+    Uint16 code;
+} inputBinding;
+
+typedef struct inputPad {
+    SDL_GameController* controller;
+    SDL_JoystickID id;
+    bool connected;
+    Uint32 held;
+    Uint32 pressed;
+    Uint32 released;
+    float axes[SDL_CONTROLLER_AXIS_MAX];
+} inputPad;
+
+typedef struct inputAction {
+    char name[32];
+    inputBinding bindings[INPUT_MAX_BINDINGS];
+    int count;
+} inputActionMap;
+
+static Uint32 inputDevices = INPUT_KEYBOARD | INPUT_MOUSE | INPUT_CONTROLLER | INPUT_TEXT;
+static Uint64 keysHeld[INPUT_KEY_WORDS];
+static Uint64 keysPressed[INPUT_KEY_WORDS];
+static Uint64 keysReleased[INPUT_KEY_WORDS];
+static Uint32 mouseButtonsHeld;
+static Uint32 mouseButtonsPressed;
+static Uint32 mouseButtonsReleased;
+static vector2 mouseAt;
+static vector2 mouseScroll;
+static inputPad pads[INPUT_MAX_PADS];
+static inputActionMap actions[INPUT_MAX_ACTIONS];
+static int actionCount;
+static Uint64 actionsHeld;
+static Uint64 actionsPressed;
+static Uint64 actionsReleased;
+
+static const Uint32 inputKeyboardEvents[] = { SDL_KEYDOWN, SDL_KEYUP };
+static const Uint32 inputTextEvents[] = { SDL_TEXTINPUT, SDL_TEXTEDITING };
+static const Uint32 inputMouseEvents[] = { SDL_MOUSEMOTION, SDL_MOUSEBUTTONDOWN, SDL_MOUSEBUTTONUP, SDL_MOUSEWHEEL };
+static const Uint32 inputControllerEvents[] = {
+    SDL_CONTROLLERAXISMOTION, SDL_CONTROLLERBUTTONDOWN, SDL_CONTROLLERBUTTONUP,
+    SDL_CONTROLLERTOUCHPADDOWN, SDL_CONTROLLERTOUCHPADMOTION, SDL_CONTROLLERTOUCHPADUP, SDL_CONTROLLERSENSORUPDATE
+};
+static const Uint32 inputUnusedEvents[] = {
+    SDL_FINGERDOWN, SDL_FINGERUP, SDL_FINGERMOTION, SDL_MULTIGESTURE,
+    SDL_DOLLARGESTURE, SDL_DOLLARRECORD, SDL_SENSORUPDATE
+};
+
+static void inputEventState(const Uint32* types, int count, bool enabled) {
+    for (int i = 0; i < count; i++) {
+        SDL_EventState(types[i], enabled ? SDL_ENABLE : SDL_DISABLE);
+    }
+}
+
+static void inputApplyFilter(void) {
+    if (!SDL_WasInit(SDL_INIT_EVENTS)) {
+        return;
+    }
+
+    inputEventState(inputKeyboardEvents, SDL_arraysize(inputKeyboardEvents), inputDevices & INPUT_KEYBOARD ? TRUE : FALSE);
+    inputEventState(inputTextEvents, SDL_arraysize(inputTextEvents), inputDevices & INPUT_TEXT ? TRUE : FALSE);
+    inputEventState(inputMouseEvents, SDL_arraysize(inputMouseEvents), inputDevices & INPUT_MOUSE ? TRUE : FALSE);
+    inputEventState(inputControllerEvents, SDL_arraysize(inputControllerEvents), inputDevices & INPUT_CONTROLLER ? TRUE : FALSE);
+    inputEventState(inputUnusedEvents, SDL_arraysize(inputUnusedEvents), FALSE);
+
+    if (inputDevices & INPUT_CONTROLLER && !SDL_WasInit(SDL_INIT_GAMECONTROLLER)) {
+        SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER);
+    }
+}
+
+void setInputDevices(Uint32 devices) {
+    inputDevices = devices;
+    inputApplyFilter();
+}
+
+static void inputSet(Uint64* bits, int index, bool on) {
+    if (on) {
+        bits[index >> 6] |= (Uint64)1 << (index & 63);
+    }
+    else {
+        bits[index >> 6] &= ~((Uint64)1 << (index & 63));
+    }
+}
+
+static bool inputGet(const Uint64* bits, int index) {
+    return index >= 0 && index < SDL_NUM_SCANCODES && (bits[index >> 6] >> (index & 63)) & 1 ? TRUE : FALSE;
+}
+
+static inputPad* inputPadFor(SDL_JoystickID id) {
+    inputPad* empty = NULL;
+
+    for (int i = 0; i < INPUT_MAX_PADS; i++) {
+        if (pads[i].connected && pads[i].id == id) {
+            return &pads[i];
+        }
+
+        if (!pads[i].connected && !empty) {
+            empty = &pads[i];
+        }
+    }
+
+    if (empty) {
+        SDL_zerop(empty);
+        empty->id = id;
+        empty->connected = TRUE;
+    }
+
+    return empty;
+}
+
+static void inputButton(Uint32* held, Uint32* pressed, Uint32* released, int index, bool down) {
+    Uint32 bit = (Uint32)1 << index;
+
+    if (index < 0 || index >= 32) {
+        return;
+    }
+
+    if (down) {
+        *pressed |= ~*held & bit;
+        *held |= bit;
+    }
+    else {
+        *released |= *held & bit;
+        *held &= ~bit;
+    }
+}
+
+static void inputBeginFrame(void) {
+    SDL_zeroa(keysPressed);
+    SDL_zeroa(keysReleased);
+    mouseButtonsPressed = mouseButtonsReleased = 0;
+    mouseScroll = vectorZero();
+
+    for (int i = 0; i < INPUT_MAX_PADS; i++) {
+        pads[i].pressed = pads[i].released = 0;
+    }
+}
+
+static void inputHandleEvent(SDL_Event* e) {
+    switch (e->type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            int key = e->key.keysym.scancode;
+
+            if (e->key.repeat || key < 0 || key >= SDL_NUM_SCANCODES) {
+                break;
+            }
+
+            if (e->type == SDL_KEYDOWN && !inputGet(keysHeld, key)) {
+                inputSet(keysPressed, key, TRUE);
+            }
+            else if (e->type == SDL_KEYUP && inputGet(keysHeld, key)) {
+                inputSet(keysReleased, key, TRUE);
+            }
+
+            inputSet(keysHeld, key, e->type == SDL_KEYDOWN);
+            break;
+        }
+
+        case SDL_MOUSEMOTION:
+            mouseAt = (vector2){ (float)e->motion.x, (float)e->motion.y };
+            break;
+
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            mouseAt = (vector2){ (float)e->button.x, (float)e->button.y };
+            inputButton(&mouseButtonsHeld, &mouseButtonsPressed, &mouseButtonsReleased, e->button.button, e->type == SDL_MOUSEBUTTONDOWN);
+            break;
+
+        case SDL_MOUSEWHEEL:
+            mouseScroll.x += e->wheel.preciseX;
+            mouseScroll.y += e->wheel.preciseY;
+            break;
+
+        case SDL_CONTROLLERDEVICEADDED:
+            if (replayState != REPLAY_PLAYING) {
+                SDL_GameController* controller = SDL_GameControllerOpen(e->cdevice.which);
+                inputPad* pad = controller ? inputPadFor(SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller))) : NULL;
+
+                if (pad) {
+                    pad->controller = controller;
+                }
+                else if (controller) {
+                    SDL_GameControllerClose(controller);
+                }
+            }
+            break;
+
+        case SDL_CONTROLLERDEVICEREMOVED:
+            for (int i = 0; i < INPUT_MAX_PADS; i++) {
+                if (pads[i].connected && pads[i].id == e->cdevice.which) {
+                    if (pads[i].controller) {
+                        SDL_GameControllerClose(pads[i].controller);
+                    }
+
+                    pads[i].released |= pads[i].held;
+                    pads[i].held = 0;
+                    pads[i].controller = NULL;
+                    pads[i].connected = FALSE;
+                    SDL_zeroa(pads[i].axes);
+                }
+            }
+            break;
+
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP: {
+            inputPad* pad = inputPadFor(e->cbutton.which);
+
+            if (pad) {
+                inputButton(&pad->held, &pad->pressed, &pad->released, e->cbutton.button, e->type == SDL_CONTROLLERBUTTONDOWN);
+            }
+            break;
+        }
+
+        case SDL_CONTROLLERAXISMOTION: {
+            inputPad* pad = inputPadFor(e->caxis.which);
+
+            if (pad && e->caxis.axis < SDL_CONTROLLER_AXIS_MAX) {
+                pad->axes[e->caxis.axis] = SDL_max(e->caxis.value / 32767.0f, -1.0f);
+            }
+            break;
+        }
+    }
+}
+
+static void inputBindingState(const inputBinding* b, bool* held, bool* pressed, bool* released) {
+    switch (b->device) {
+        case INPUT_KEYBOARD:
+            *held = inputGet(keysHeld, b->code);
+            *pressed = inputGet(keysPressed, b->code);
+            *released = inputGet(keysReleased, b->code);
+            break;
+
+        case INPUT_MOUSE:
+            *held = (mouseButtonsHeld >> b->code) & 1 ? TRUE : FALSE;
+            *pressed = (mouseButtonsPressed >> b->code) & 1 ? TRUE : FALSE;
+            *released = (mouseButtonsReleased >> b->code) & 1 ? TRUE : FALSE;
+            break;
+
+        default:
+            for (int i = 0; i < INPUT_MAX_PADS; i++) {
+                if (b->pad < 0 || b->pad == i) {
+                    *held = *held || (pads[i].held >> b->code) & 1 ? TRUE : FALSE;
+                    *pressed = *pressed || (pads[i].pressed >> b->code) & 1 ? TRUE : FALSE;
+                    *released = *released || (pads[i].released >> b->code) & 1 ? TRUE : FALSE;
+                }
+            }
+            break;
+    }
+}
+
+// An action is held while any of its bindings is. A binding tapped and let go
+// within one frame still reports both edges.
+static void inputEndFrame(void) {
+    Uint64 previous = actionsHeld;
+    Uint64 taps = 0;
+    Uint64 lifts = 0;
+
+    actionsHeld = 0;
+
+    for (int i = 0; i < actionCount; i++) {
+        for (int j = 0; j < actions[i].count; j++) {
+            bool held = FALSE;
+            bool pressed = FALSE;
+            bool released = FALSE;
+
+            inputBindingState(&actions[i].bindings[j], &held, &pressed, &released);
+            actionsHeld |= (Uint64)held << i;
+            taps |= (Uint64)pressed << i;
+            lifts |= (Uint64)released << i;
+        }
+    }
+
+    actionsPressed = (actionsHeld & ~previous) | (taps & ~actionsHeld & ~previous);
+    actionsReleased = (previous & ~actionsHeld) | (lifts & ~actionsHeld & ~previous);
+}
+
+static void inputLatch(void) {
+    int x;
+    int y;
+
+    SDL_PumpEvents();
+
+    if (inputDevices & INPUT_MOUSE) {
+        SDL_GetMouseState(&x, &y);
+        mouseAt = (vector2){ (float)x, (float)y };
+    }
+
+    for (int i = 0; i < INPUT_MAX_PADS; i++) {
+        if (pads[i].controller) {
+            for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++) {
+                pads[i].axes[axis] = SDL_max(SDL_GameControllerGetAxis(pads[i].controller, axis) / 32767.0f, -1.0f);
+            }
+        }
+    }
+}
+
+bool keyHeld(SDL_Scancode key) {
+    return inputGet(keysHeld, key);
+}
+
+bool keyPressed(SDL_Scancode key) {
+    return inputGet(keysPressed, key);
+}
+
+bool keyReleased(SDL_Scancode key) {
+    return inputGet(keysReleased, key);
+}
+
+bool mouseHeld(int button) {
+    return button >= 0 && button < 32 && (mouseButtonsHeld >> button) & 1 ? TRUE : FALSE;
+}
+
+bool mousePressed(int button) {
+    return button >= 0 && button < 32 && (mouseButtonsPressed >> button) & 1 ? TRUE : FALSE;
+}
+
+bool mouseReleased(int button) {
+    return button >= 0 && button < 32 && (mouseButtonsReleased >> button) & 1 ? TRUE : FALSE;
+}
+
+vector2 mousePosition(void) {
+    return mouseAt;
+}
+
+vector2 mouseWheel(void) {
+    return mouseScroll;
+}
+
+bool padConnected(int pad) {
+    return pad >= 0 && pad < INPUT_MAX_PADS && pads[pad].connected;
+}
+
+bool padHeld(int pad, SDL_GameControllerButton button) {
+    return pad >= 0 && pad < INPUT_MAX_PADS && button >= 0 && button < 32 && (pads[pad].held >> button) & 1 ? TRUE : FALSE;
+}
+
+bool padPressed(int pad, SDL_GameControllerButton button) {
+    return pad >= 0 && pad < INPUT_MAX_PADS && button >= 0 && button < 32 && (pads[pad].pressed >> button) & 1 ? TRUE : FALSE;
+}
+
+bool padReleased(int pad, SDL_GameControllerButton button) {
+    return pad >= 0 && pad < INPUT_MAX_PADS && button >= 0 && button < 32 && (pads[pad].released >> button) & 1 ? TRUE : FALSE;
+}
+
+float padAxis(int pad, SDL_GameControllerAxis axis) {
+    return padConnected(pad) && axis >= 0 && axis < SDL_CONTROLLER_AXIS_MAX ? pads[pad].axes[axis] : 0.0f;
+}
+
+int inputAction(const char* name) {
+    if (!name) {
+        return -1;
+    }
+
+    for (int i = 0; i < actionCount; i++) {
+        if (strcmp(actions[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    if (actionCount == INPUT_MAX_ACTIONS || strlen(name) >= sizeof(actions[0].name)) {
+        return -1;
+    }
+
+    inputActionMap* a = &actions[actionCount];
+    SDL_zerop(a);
+    strcpy(a->name, name);
+
+    return actionCount++;
+}
+
+static bool inputBind(int action, Uint8 device, int pad, int code) {
+    if (action < 0 || action >= actionCount || actions[action].count == INPUT_MAX_BINDINGS) {
+        return FALSE;
+    }
+
+    actions[action].bindings[actions[action].count++] = (inputBinding){ device, (Sint8)pad, (Uint16)code };
+
+    return TRUE;
+}
+
+bool inputBindKey(int action, SDL_Scancode key) {
+    return key > SDL_SCANCODE_UNKNOWN && key < SDL_NUM_SCANCODES && inputBind(action, INPUT_KEYBOARD, 0, key);
+}
+
+bool inputBindMouse(int action, int button) {
+    return button > 0 && button < 32 && inputBind(action, INPUT_MOUSE, 0, button);
+}
+
+bool inputBindPad(int action, int pad, SDL_GameControllerButton button) {
+    return pad >= -1 && pad < INPUT_MAX_PADS && button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX && inputBind(action, INPUT_CONTROLLER, pad, button);
+}
+
+void inputUnbind(int action) {
+    if (action >= 0 && action < actionCount) {
+        actions[action].count = 0;
+    }
+}
+
+bool actionHeld(int action) {
+    return action >= 0 && action < actionCount && (actionsHeld >> action) & 1 ? TRUE : FALSE;
+}
+
+bool actionPressed(int action) {
+    return action >= 0 && action < actionCount && (actionsPressed >> action) & 1 ? TRUE : FALSE;
+}
+
+bool actionReleased(int action) {
+    return action >= 0 && action < actionCount && (actionsReleased >> action) & 1 ? TRUE : FALSE;
+}
+
+static void inputFree(void) {
+    for (int i = 0; i < INPUT_MAX_PADS; i++) {
+        if (pads[i].controller) {
+            SDL_GameControllerClose(pads[i].controller);
+        }
+    }
+
+    SDL_zeroa(pads);
+    SDL_zeroa(keysHeld);
+    mouseButtonsHeld = 0;
+    actionCount = 0;
+    actionsHeld = actionsPressed = actionsReleased = 0;
+    inputBeginFrame();
+}
+
+// Audio
+
+#define AUDIO_FREQUENCY 48000
+#define AUDIO_SAMPLES 512
+#define AUDIO_VOICES 64
+#define AUDIO_QUEUE 1024
+#define MUSIC_RING 16384
+#define MUSIC_CHUNK 16384
+
+enum {
+    AUDIO_PLAY,
+    AUDIO_STOP,
+    AUDIO_VOLUME,
+    AUDIO_MASTER
+};
+
+enum {
+    MUSIC_STREAMING,
+    MUSIC_ENDED,
+    MUSIC_REWIND
+};
+
+struct sound {
+    float* samples;
+    Uint32 frames;
+};
+
+struct music {
+    SDL_RWops* rw;
+    SDL_AudioStream* stream;
+    Sint64 dataStart;
+    Uint32 dataSize;
+    Uint32 dataRead;
+    int frameSize;
+    bool drained;
+    Uint8* chunk;
+    float* ring;
+    SDL_atomic_t written;
+    SDL_atomic_t consumed;
+    SDL_atomic_t loop;
+    SDL_atomic_t state;
+    SDL_atomic_t voice;
+    SDL_atomic_t quit;
+    SDL_sem* wake;
+    SDL_Thread* thread;
+};
+
+typedef struct audioCommand {
+    Uint8 type;
+    bool loop;
+    voice id;
+    const sound* s;
+    float volume;
+    float pan;
+    music* m;
+} audioCommand;
+
+typedef struct audioVoice {
+    voice id;
+    const sound* s;
+    music* m;
+    Uint32 position;
+    bool loop;
+    bool stopping;
+    float gainLeft;
+    float gainRight;
+    float targetLeft;
+    float targetRight;
+} audioVoice;
+
+static SDL_AudioDeviceID audioDevice;
+static SDL_AudioSpec audioSpec;
+static audioCommand audioQueue[AUDIO_QUEUE];
+static SDL_atomic_t audioHead;
+static SDL_atomic_t audioTail;
+static audioVoice audioVoices[AUDIO_VOICES];
+static float audioMaster = 1.0f;
+static voice audioNextVoice;
+
+static void audioGains(float volume, float pan, float* left, float* right) {
+    pan = SDL_clamp(pan, -1.0f, 1.0f);
+    *left = volume * SDL_min(1.0f, 1.0f - pan);
+    *right = volume * SDL_min(1.0f, 1.0f + pan);
+}
+
+// The game side is the only producer and the audio callback the only consumer,
+// so each index is written by one side and read by the other.
+static bool audioPush(const audioCommand* c) {
+    int head = SDL_AtomicGet(&audioHead);
+
+    if (!audioDevice || head - SDL_AtomicGet(&audioTail) == AUDIO_QUEUE) {
+        return FALSE;
+    }
+
+    audioQueue[head & (AUDIO_QUEUE - 1)] = *c;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&audioHead, head + 1);
+
+    return TRUE;
+}
+
+static audioVoice* audioFind(voice id) {
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if ((audioVoices[i].s || audioVoices[i].m) && audioVoices[i].id == id) {
+            return &audioVoices[i];
+        }
+    }
+
+    return NULL;
+}
+
+// The game side sets the music's voice when it queues a play; the callback
+// clears it when that voice lets go of the music.
+static void audioDetachMusic(audioVoice* v) {
+    SDL_AtomicCAS(&v->m->voice, (int)v->id, 0);
+    v->m = NULL;
+}
+
+static void audioApply(const audioCommand* c) {
+    audioVoice* v = c->type == AUDIO_PLAY || c->type == AUDIO_MASTER ? NULL : audioFind(c->id);
+
+    switch (c->type) {
+        case AUDIO_PLAY:
+            for (int i = 0; i < AUDIO_VOICES; i++) {
+                if (c->m && audioVoices[i].m == c->m) {
+                    SDL_AtomicCAS(&c->m->voice, (int)c->id, (int)audioVoices[i].id);
+                    v = NULL;
+                    break;
+                }
+
+                if (!v && !audioVoices[i].s && !audioVoices[i].m) {
+                    v = &audioVoices[i];
+                }
+            }
+
+            if (!v && c->m) {
+                SDL_AtomicCAS(&c->m->voice, (int)c->id, 0);
+            }
+
+            if (v) {
+                SDL_zerop(v);
+                v->id = c->id;
+                v->s = c->s;
+                v->m = c->m;
+                v->loop = c->loop;
+                audioGains(c->volume, c->pan, &v->targetLeft, &v->targetRight);
+                v->gainLeft = v->targetLeft;
+                v->gainRight = v->targetRight;
+            }
+            break;
+
+        case AUDIO_STOP:
+            if (v) {
+                v->stopping = TRUE;
+                v->targetLeft = v->targetRight = 0;
+            }
+            break;
+
+        case AUDIO_VOLUME:
+            if (v && !v->stopping) {
+                audioGains(c->volume, c->pan, &v->targetLeft, &v->targetRight);
+            }
+            break;
+
+        case AUDIO_MASTER:
+            audioMaster = c->volume;
+            break;
+    }
+}
+
+static void audioDrain(void) {
+    int tail = SDL_AtomicGet(&audioTail);
+    int head = SDL_AtomicGet(&audioHead);
+
+    SDL_MemoryBarrierAcquire();
+
+    for (; tail != head; tail++) {
+        audioApply(&audioQueue[tail & (AUDIO_QUEUE - 1)]);
+    }
+
+    SDL_AtomicSet(&audioTail, tail);
+}
+
+// Adds frames of interleaved stereo to out, moving each channel's gain linearly
+// from its current value by step per frame.
+static void audioMix(float* out, const float* in, int frames, float left, float right, float stepLeft, float stepRight) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 gain = _mm_setr_ps(left, right, left + stepLeft, right + stepRight);
+    __m128 step = _mm_setr_ps(2 * stepLeft, 2 * stepRight, 2 * stepLeft, 2 * stepRight);
+
+    for (; i + 2 <= frames; i += 2) {
+        __m128 mixed = _mm_add_ps(_mm_loadu_ps(out + i * 2), _mm_mul_ps(_mm_loadu_ps(in + i * 2), gain));
+        _mm_storeu_ps(out + i * 2, mixed);
+        gain = _mm_add_ps(gain, step);
+    }
+#endif
+
+    for (; i < frames; i++) {
+        out[i * 2] += in[i * 2] * (left + stepLeft * i);
+        out[i * 2 + 1] += in[i * 2 + 1] * (right + stepRight * i);
+    }
+}
+
+// Music plays whatever the reader thread has buffered; an underrun leaves a
+// gap rather than waiting for it.
+static void musicMix(audioVoice* v, float* out, int frames, float stepLeft, float stepRight) {
+    music* m = v->m;
+    Uint32 consumed = (Uint32)SDL_AtomicGet(&m->consumed);
+    Uint32 available = (Uint32)SDL_AtomicGet(&m->written) - consumed;
+    int count = SDL_min(frames, (int)available);
+
+    SDL_MemoryBarrierAcquire();
+
+    for (int done = 0; done < count;) {
+        Uint32 at = (consumed + done) & (MUSIC_RING - 1);
+        int run = SDL_min(count - done, (int)(MUSIC_RING - at));
+
+        audioMix(out + done * 2, m->ring + (size_t)at * 2, run,
+                 v->gainLeft + stepLeft * done, v->gainRight + stepRight * done, stepLeft, stepRight);
+        done += run;
+    }
+
+    SDL_AtomicSet(&m->consumed, (int)(consumed + count));
+    SDL_SemPost(m->wake);
+
+    if (count < frames && SDL_AtomicGet(&m->state) == MUSIC_ENDED) {
+        audioDetachMusic(v);
+    }
+}
+
+static void audioVoiceMix(audioVoice* v, float* out, int frames) {
+    float stepLeft = (v->targetLeft - v->gainLeft) / frames;
+    float stepRight = (v->targetRight - v->gainRight) / frames;
+    int done = 0;
+
+    if (v->m) {
+        musicMix(v, out, frames, stepLeft, stepRight);
+    }
+
+    while (done < frames && v->s) {
+        int count = SDL_min(frames - done, (int)(v->s->frames - v->position));
+
+        audioMix(out + done * 2, v->s->samples + (size_t)v->position * 2, count,
+                 v->gainLeft + stepLeft * done, v->gainRight + stepRight * done, stepLeft, stepRight);
+        done += count;
+        v->position += count;
+
+        if (v->position >= v->s->frames) {
+            v->position = 0;
+
+            if (!v->loop) {
+                v->s = NULL;
+            }
+        }
+    }
+
+    v->gainLeft = v->targetLeft;
+    v->gainRight = v->targetRight;
+
+    if (v->stopping) {
+        v->s = NULL;
+
+        if (v->m) {
+            audioDetachMusic(v);
+        }
+    }
+}
+
+static void audioClamp(float* out, int count, float master) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 gain = _mm_set1_ps(master);
+    __m128 low = _mm_set1_ps(-1.0f);
+    __m128 high = _mm_set1_ps(1.0f);
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(out + i), gain), low), high));
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = SDL_clamp(out[i] * master, -1.0f, 1.0f);
+    }
+}
+
+static void SDLCALL audioCallback(void* data, Uint8* stream, int length) {
+    float* out = (float*)stream;
+    int frames = length / (int)(2 * sizeof(float));
+
+    (void)data;
+
+    SDL_memset(stream, 0, length);
+    audioDrain();
+
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if (audioVoices[i].s || audioVoices[i].m) {
+            audioVoiceMix(&audioVoices[i], out, frames);
+        }
+    }
+
+    audioClamp(out, frames * 2, audioMaster);
+}
+
+bool audioOpen(void) {
+    SDL_AudioSpec desired;
+
+    if (audioDevice) {
+        return TRUE;
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        return FALSE;
+    }
+
+    SDL_zero(desired);
+    desired.freq = AUDIO_FREQUENCY;
+    desired.format = AUDIO_F32SYS;
+    desired.channels = 2;
+    desired.samples = AUDIO_SAMPLES;
+    desired.callback = audioCallback;
+
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &desired, &audioSpec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+
+    if (!audioDevice) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return FALSE;
+    }
+
+    SDL_zeroa(audioVoices);
+    SDL_AtomicSet(&audioHead, 0);
+    SDL_AtomicSet(&audioTail, 0);
+    audioMaster = 1.0f;
+    SDL_PauseAudioDevice(audioDevice, 0);
+
+    return TRUE;
+}
+
+sound* soundLoad(const char* path) {
+    SDL_AudioSpec spec;
+    SDL_AudioCVT cvt;
+    Uint8* buffer;
+    Uint32 length;
+    size_t size = 0;
+    const void* data = packFind(path, &size);
+    SDL_RWops* rw;
+
+    if (!audioDevice) {
+        return NULL;
+    }
+
+    rw = !data ? SDL_RWFromFile(path, "rb") : size <= SDL_MAX_SINT32 ? SDL_RWFromConstMem(data, (int)size) : NULL;
+
+    if (!rw || !SDL_LoadWAV_RW(rw, 1, &spec, &buffer, &length)) {
+        return NULL;
+    }
+
+    if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_F32SYS, 2, audioSpec.freq) < 0) {
+        SDL_FreeWAV(buffer);
+        return NULL;
+    }
+
+    sound* s = memoryAlloc(MEMORY_AUDIO, sizeof(sound));
+    cvt.len = (int)length;
+    cvt.buf = memoryAlloc(MEMORY_AUDIO, (size_t)length * cvt.len_mult);
+
+    if (!s || !cvt.buf) {
+        memoryFree(s);
+        memoryFree(cvt.buf);
+        SDL_FreeWAV(buffer);
+        return NULL;
+    }
+
+    memcpy(cvt.buf, buffer, length);
+    SDL_FreeWAV(buffer);
+
+    if (cvt.needed && SDL_ConvertAudio(&cvt) < 0) {
+        memoryFree(cvt.buf);
+        memoryFree(s);
+        return NULL;
+    }
+
+    s->samples = (float*)cvt.buf;
+    s->frames = (Uint32)(cvt.needed ? cvt.len_cvt : cvt.len) / (2 * sizeof(float));
+
+    return s;
+}
+
+// Locking waits for a callback in progress to finish. With the device locked
+// the queue can be drained here, after which nothing refers to the sound.
+void soundDestroy(sound* s) {
+    if (!s) {
+        return;
+    }
+
+    if (audioDevice) {
+        SDL_LockAudioDevice(audioDevice);
+        audioDrain();
+
+        for (int i = 0; i < AUDIO_VOICES; i++) {
+            if (audioVoices[i].s == s) {
+                audioVoices[i].s = NULL;
+            }
+        }
+
+        SDL_UnlockAudioDevice(audioDevice);
+    }
+
+    memoryFree(s->samples);
+    memoryFree(s);
+}
+
+voice soundPlay(sound* s, float volume, float pan, bool loop) {
+    audioCommand c = { AUDIO_PLAY, loop, 0, s, volume, pan, NULL };
+
+    if (!s || s->frames == 0) {
+        return 0;
+    }
+
+    c.id = ++audioNextVoice ? audioNextVoice : ++audioNextVoice;
+
+    return audioPush(&c) ? c.id : 0;
+}
+
+void voiceStop(voice v) {
+    audioCommand c = { AUDIO_STOP, FALSE, v, NULL, 0, 0, NULL };
+
+    if (v) {
+        audioPush(&c);
+    }
+}
+
+void voiceSetVolume(voice v, float volume, float pan) {
+    audioCommand c = { AUDIO_VOLUME, FALSE, v, NULL, volume, pan, NULL };
+
+    if (v) {
+        audioPush(&c);
+    }
+}
+
+void setMasterVolume(float volume) {
+    audioCommand c = { AUDIO_MASTER, FALSE, 0, NULL, SDL_max(volume, 0.0f), 0, NULL };
+    audioPush(&c);
+}
+
+// Finds the fmt and data chunks of a RIFF WAVE file and leaves the stream at
+// the first sample.
+static bool musicParseWave(music* m, SDL_AudioFormat* format, int* channels, int* rate) {
+    Uint8 id[4];
+    bool haveFormat = FALSE;
+
+    if (SDL_RWread(m->rw, id, 4, 1) != 1 || memcmp(id, "RIFF", 4) != 0) {
+        return FALSE;
+    }
+
+    SDL_ReadLE32(m->rw);
+
+    if (SDL_RWread(m->rw, id, 4, 1) != 1 || memcmp(id, "WAVE", 4) != 0) {
+        return FALSE;
+    }
+
+    while (SDL_RWread(m->rw, id, 4, 1) == 1) {
+        Uint32 size = SDL_ReadLE32(m->rw);
+        Sint64 next = SDL_RWtell(m->rw) + size + (size & 1);
+
+        if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+            Uint16 tag = SDL_ReadLE16(m->rw);
+            *channels = SDL_ReadLE16(m->rw);
+            *rate = (int)SDL_ReadLE32(m->rw);
+            SDL_ReadLE32(m->rw);
+            SDL_ReadLE16(m->rw);
+            Uint16 bits = SDL_ReadLE16(m->rw);
+
+            if (tag == 0xFFFE && size >= 26) {
+                SDL_ReadLE16(m->rw);
+                SDL_ReadLE16(m->rw);
+                SDL_ReadLE32(m->rw);
+                tag = SDL_ReadLE16(m->rw);
+            }
+
+            *format = tag == 3 && bits == 32 ? AUDIO_F32LSB :
+                      tag == 1 && bits == 8 ? AUDIO_U8 :
+                      tag == 1 && bits == 16 ? AUDIO_S16LSB :
+                      tag == 1 && bits == 32 ? AUDIO_S32LSB : 0;
+            haveFormat = *format && *channels > 0 && *rate > 0;
+        }
+        else if (memcmp(id, "data", 4) == 0) {
+            m->dataStart = SDL_RWtell(m->rw);
+            m->dataSize = size;
+            return haveFormat;
+        }
+
+        if (SDL_RWseek(m->rw, next, RW_SEEK_SET) < 0) {
+            return FALSE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Reads whole source frames only, so the stream never sees a split sample.
+static void musicFill(music* m) {
+    Uint32 written = (Uint32)SDL_AtomicGet(&m->written);
+    Uint32 space = MUSIC_RING - (written - (Uint32)SDL_AtomicGet(&m->consumed));
+    int frameSize = 2 * sizeof(float);
+
+    if (SDL_AtomicGet(&m->state) == MUSIC_REWIND) {
+        SDL_AudioStreamClear(m->stream);
+        m->drained = SDL_RWseek(m->rw, m->dataStart, RW_SEEK_SET) < 0;
+        m->dataRead = 0;
+        SDL_AtomicSet(&m->state, MUSIC_STREAMING);
+    }
+
+    while (!m->drained && !SDL_AtomicGet(&m->quit) && SDL_AudioStreamAvailable(m->stream) < (int)space * frameSize) {
+        size_t want = SDL_min(MUSIC_CHUNK, m->dataSize - m->dataRead) / m->frameSize;
+        size_t got = want ? SDL_RWread(m->rw, m->chunk, m->frameSize, want) * m->frameSize : 0;
+
+        if (got > 0) {
+            m->dataRead += (Uint32)got;
+
+            if (SDL_AudioStreamPut(m->stream, m->chunk, (int)got) < 0) {
+                SDL_AudioStreamFlush(m->stream);
+                m->drained = TRUE;
+            }
+        }
+        else if (SDL_AtomicGet(&m->loop) && m->dataRead > 0 && SDL_RWseek(m->rw, m->dataStart, RW_SEEK_SET) >= 0) {
+            m->dataRead = 0;
+        }
+        else {
+            SDL_AudioStreamFlush(m->stream);
+            m->drained = TRUE;
+        }
+    }
+
+    int frames = SDL_min(SDL_AudioStreamAvailable(m->stream) / frameSize, (int)space);
+
+    for (int done = 0; done < frames;) {
+        Uint32 at = (written + done) & (MUSIC_RING - 1);
+        int run = SDL_min(frames - done, (int)(MUSIC_RING - at));
+
+        SDL_AudioStreamGet(m->stream, m->ring + (size_t)at * 2, run * frameSize);
+        done += run;
+    }
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&m->written, (int)(written + frames));
+
+    if (m->drained && SDL_AudioStreamAvailable(m->stream) == 0) {
+        SDL_AtomicCAS(&m->state, MUSIC_STREAMING, MUSIC_ENDED);
+    }
+}
+
+static int SDLCALL musicRead(void* data) {
+    music* m = data;
+
+    while (!SDL_AtomicGet(&m->quit)) {
+        musicFill(m);
+        SDL_SemWaitTimeout(m->wake, 20);
+    }
+
+    return 0;
+}
+
+// Keeps at most MUSIC_RING frames decoded ahead, about a third of a second at
+// 48 kHz, whatever the length of the track.
+music* musicOpen(const char* path) {
+    SDL_AudioFormat format = 0;
+    int channels = 0;
+    int rate = 0;
+    size_t size = 0;
+    const void* data = packFind(path, &size);
+    music* m = audioDevice ? memoryCalloc(MEMORY_AUDIO, 1, sizeof(music)) : NULL;
+
+    if (!m) {
+        return NULL;
+    }
+
+    m->rw = !data ? SDL_RWFromFile(path, "rb") : size <= SDL_MAX_SINT32 ? SDL_RWFromConstMem(data, (int)size) : NULL;
+
+    if (!m->rw || !musicParseWave(m, &format, &channels, &rate)) {
+        musicClose(m);
+        return NULL;
+    }
+
+    m->frameSize = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+    m->stream = SDL_NewAudioStream(format, (Uint8)channels, rate, AUDIO_F32SYS, 2, audioSpec.freq);
+    m->chunk = memoryAlloc(MEMORY_AUDIO, MUSIC_CHUNK);
+    m->ring = memoryAlloc(MEMORY_AUDIO, MUSIC_RING * 2 * sizeof(float));
+    m->wake = SDL_CreateSemaphore(0);
+
+    if (!m->stream || !m->chunk || !m->ring || !m->wake) {
+        musicClose(m);
+        return NULL;
+    }
+
+    musicFill(m);
+    m->thread = SDL_CreateThread(musicRead, "nest music", m);
+
+    if (!m->thread) {
+        musicClose(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+void musicClose(music* m) {
+    if (!m) {
+        return;
+    }
+
+    if (audioDevice) {
+        SDL_LockAudioDevice(audioDevice);
+        audioDrain();
+
+        for (int i = 0; i < AUDIO_VOICES; i++) {
+            if (audioVoices[i].m == m) {
+                audioVoices[i].m = NULL;
+            }
+        }
+
+        SDL_UnlockAudioDevice(audioDevice);
+    }
+
+    if (m->thread) {
+        SDL_AtomicSet(&m->quit, 1);
+        SDL_SemPost(m->wake);
+        SDL_WaitThread(m->thread, NULL);
+    }
+
+    if (m->wake) {
+        SDL_DestroySemaphore(m->wake);
+    }
+
+    if (m->stream) {
+        SDL_FreeAudioStream(m->stream);
+    }
+
+    if (m->rw) {
+        SDL_RWclose(m->rw);
+    }
+
+    memoryFree(m->chunk);
+    memoryFree(m->ring);
+    memoryFree(m);
+}
+
+// A track that has ended starts again from the top. Playing a track that
+// already has a voice only updates that voice and returns it.
+voice musicPlay(music* m, float volume, bool loop) {
+    audioCommand c = { AUDIO_PLAY, FALSE, 0, NULL, volume, 0, m };
+
+    if (!m) {
+        return 0;
+    }
+
+    SDL_AtomicSet(&m->loop, loop);
+    SDL_AtomicCAS(&m->state, MUSIC_ENDED, MUSIC_REWIND);
+    SDL_SemPost(m->wake);
+
+    voice playing = (voice)SDL_AtomicGet(&m->voice);
+
+    if (playing) {
+        voiceSetVolume(playing, volume, 0);
+        return playing;
+    }
+
+    c.id = ++audioNextVoice ? audioNextVoice : ++audioNextVoice;
+    SDL_AtomicSet(&m->voice, (int)c.id);
+
+    if (!audioPush(&c)) {
+        SDL_AtomicSet(&m->voice, 0);
+        return 0;
+    }
+
+    return c.id;
+}
+
+bool musicFinished(music* m) {
+    return !m || (SDL_AtomicGet(&m->state) == MUSIC_ENDED && SDL_AtomicGet(&m->written) == SDL_AtomicGet(&m->consumed));
+}
+
+static void audioFree(void) {
+    if (audioDevice) {
+        SDL_CloseAudioDevice(audioDevice);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        audioDevice = 0;
+    }
+}
+
+// Pathfinding
+
+#define PATH_SQRT2 1.41421356f
+
+typedef struct pathNode {
+    float priority;
+    int cell;
+} pathNode;
+
+// Each search keeps its own scratch arrays, stamped rather than cleared, and
+// goes back to the grid's pool when it finishes so later searches reuse it.
+typedef struct pathSearch {
+    float* costs;
+    int* parents;
+    Uint32* marks;
+    Uint32 stamp;
+    pathNode* heap;
+    int heapCount;
+    int heapCapacity;
+    struct pathSearch* next;
+} pathSearch;
+
+struct pathGrid {
+    int columns;
+    int rows;
+    Uint8* costs;
+    int weighted;
+    pathSearch* idle;
+    SDL_SpinLock lock;
+};
+
+struct pathField {
+    pathGrid* grid;
+    float* distances;
+    SDL_Point goal;
+};
+
+typedef struct pathBatch {
+    pathGrid* grid;
+    pathRequest* requests;
+} pathBatch;
+
+static const int pathDx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int pathDy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+pathGrid* pathGridCreate(int columns, int rows) {
+    if (columns <= 0 || rows <= 0 || columns > SDL_MAX_SINT32 / rows) {
+        return NULL;
+    }
+
+    pathGrid* g = memoryCalloc(MEMORY_GAME, 1, sizeof(pathGrid));
+
+    if (!g) {
+        return NULL;
+    }
+
+    g->costs = memoryAlloc(MEMORY_GAME, (size_t)columns * rows);
+
+    if (!g->costs) {
+        memoryFree(g);
+        return NULL;
+    }
+
+    memset(g->costs, 1, (size_t)columns * rows);
+    g->columns = columns;
+    g->rows = rows;
+
+    return g;
+}
+
+static void pathSearchDestroy(pathSearch* s) {
+    memoryFree(s->costs);
+    memoryFree(s->parents);
+    memoryFree(s->marks);
+    memoryFree(s->heap);
+    memoryFree(s);
+}
+
+void pathGridDestroy(pathGrid* g) {
+    if (!g) {
+        return;
+    }
+
+    while (g->idle) {
+        pathSearch* next = g->idle->next;
+        pathSearchDestroy(g->idle);
+        g->idle = next;
+    }
+
+    memoryFree(g->costs);
+    memoryFree(g);
+}
+
+void pathSetCost(pathGrid* g, int x, int y, int cost) {
+    if (!g || x < 0 || y < 0 || x >= g->columns || y >= g->rows) {
+        return;
+    }
+
+    Uint8* cell = &g->costs[y * g->columns + x];
+    Uint8 value = (Uint8)SDL_clamp(cost, 0, 255);
+
+    g->weighted += (value > 1) - (*cell > 1);
+    *cell = value;
+}
+
+int pathGetCost(const pathGrid* g, int x, int y) {
+    if (!g || x < 0 || y < 0 || x >= g->columns || y >= g->rows) {
+        return 0;
+    }
+
+    return g->costs[y * g->columns + x];
+}
+
+static bool pathOpen(const pathGrid* g, int x, int y) {
+    return x >= 0 && y >= 0 && x < g->columns && y < g->rows && g->costs[y * g->columns + x] != 0;
+}
+
+// Diagonal steps may not cut a blocked corner.
+static bool pathStep(const pathGrid* g, int x, int y, int dx, int dy) {
+    return pathOpen(g, x + dx, y + dy) && (dx == 0 || dy == 0 || (pathOpen(g, x + dx, y) && pathOpen(g, x, y + dy)));
+}
+
+// Bit d is set when direction d can be taken from x, y. The first four
+// directions are straight, so the diagonals can reuse their results.
+static int pathNeighbours(const pathGrid* g, int x, int y) {
+    int mask = 0;
+
+    for (int d = 0; d < 4; d++) {
+        if (pathOpen(g, x + pathDx[d], y + pathDy[d])) {
+            mask |= 1 << d;
+        }
+    }
+
+    for (int d = 4; d < 8; d++) {
+        int straight = (1 << (pathDx[d] > 0 ? 0 : 1)) | (1 << (pathDy[d] > 0 ? 2 : 3));
+
+        if ((mask & straight) == straight && pathOpen(g, x + pathDx[d], y + pathDy[d])) {
+            mask |= 1 << d;
+        }
+    }
+
+    return mask;
+}
+
+static float pathOctile(int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+
+    return (float)SDL_max(dx, dy) + (PATH_SQRT2 - 1.0f) * SDL_min(dx, dy);
+}
+
+static pathSearch* pathSearchAcquire(pathGrid* g) {
+    SDL_AtomicLock(&g->lock);
+    pathSearch* s = g->idle;
+
+    if (s) {
+        g->idle = s->next;
+    }
+
+    SDL_AtomicUnlock(&g->lock);
+
+    if (!s) {
+        size_t cells = (size_t)g->columns * g->rows;
+
+        s = memoryCalloc(MEMORY_GAME, 1, sizeof(pathSearch));
+
+        if (!s) {
+            return NULL;
+        }
+
+        s->costs = memoryAlloc(MEMORY_GAME, cells * sizeof(float));
+        s->parents = memoryAlloc(MEMORY_GAME, cells * sizeof(int));
+        s->marks = memoryCalloc(MEMORY_GAME, cells, sizeof(Uint32));
+
+        if (!s->costs || !s->parents || !s->marks) {
+            pathSearchDestroy(s);
+            return NULL;
+        }
+    }
+
+    if (s->stamp >= 0xFFFFFFF0u) {
+        memset(s->marks, 0, (size_t)g->columns * g->rows * sizeof(Uint32));
+        s->stamp = 0;
+    }
+
+    s->stamp += 2;
+    s->heapCount = 0;
+
+    return s;
+}
+
+static void pathSearchRelease(pathGrid* g, pathSearch* s) {
+    SDL_AtomicLock(&g->lock);
+    s->next = g->idle;
+    g->idle = s;
+    SDL_AtomicUnlock(&g->lock);
+}
+
+static bool pathPush(pathSearch* s, int cell, float priority) {
+    if (s->heapCount == s->heapCapacity) {
+        int capacity = s->heapCapacity ? s->heapCapacity * 2 : 256;
+        pathNode* heap = memoryRealloc(MEMORY_GAME, s->heap, capacity * sizeof(pathNode));
+
+        if (!heap) {
+            return FALSE;
+        }
+
+        s->heap = heap;
+        s->heapCapacity = capacity;
+    }
+
+    int i = s->heapCount++;
+
+    while (i > 0 && s->heap[(i - 1) / 2].priority > priority) {
+        s->heap[i] = s->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    s->heap[i].priority = priority;
+    s->heap[i].cell = cell;
+
+    return TRUE;
+}
+
+static pathNode pathPop(pathSearch* s) {
+    pathNode top = s->heap[0];
+    pathNode last = s->heap[--s->heapCount];
+    int i = 0;
+
+    for (;;) {
+        int child = i * 2 + 1;
+
+        if (child >= s->heapCount) {
+            break;
+        }
+
+        if (child + 1 < s->heapCount && s->heap[child + 1].priority < s->heap[child].priority) {
+            child++;
+        }
+
+        if (s->heap[child].priority >= last.priority) {
+            break;
+        }
+
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+
+    if (s->heapCount > 0) {
+        s->heap[i] = last;
+    }
+
+    return top;
+}
+
+// A mark of stamp means the cell has a cost this search, stamp + 1 that it has
+// been expanded. Cells are pushed again when their cost drops and the stale
+// entries are skipped when they come off the heap.
+static bool pathVisit(pathSearch* s, int cell, int parent, float cost, float priority) {
+    if (s->marks[cell] == s->stamp + 1 || (s->marks[cell] == s->stamp && cost >= s->costs[cell])) {
+        return TRUE;
+    }
+
+    s->marks[cell] = s->stamp;
+    s->costs[cell] = cost;
+    s->parents[cell] = parent;
+
+    return pathPush(s, cell, priority);
+}
+
+// Walks from x, y in one direction until it reaches the goal or a cell with a
+// forced neighbour, the rules for a grid that never cuts corners. A diagonal
+// run also stops where either of its straight runs would find something.
+static bool pathJump(const pathGrid* g, int x, int y, int dx, int dy, SDL_Point goal, SDL_Point* found) {
+    for (;;) {
+        if (!pathOpen(g, x, y)) {
+            return FALSE;
+        }
+
+        if (x == goal.x && y == goal.y) {
+            break;
+        }
+
+        if (dx != 0 && dy != 0) {
+            if (pathJump(g, x + dx, y, dx, 0, goal, found) || pathJump(g, x, y + dy, 0, dy, goal, found)) {
+                break;
+            }
+
+            if (!pathOpen(g, x + dx, y) || !pathOpen(g, x, y + dy)) {
+                return FALSE;
+            }
+        }
+        else if (dx != 0) {
+            if ((pathOpen(g, x, y - 1) && !pathOpen(g, x - dx, y - 1)) ||
+                (pathOpen(g, x, y + 1) && !pathOpen(g, x - dx, y + 1))) {
+                break;
+            }
+        }
+        else if ((pathOpen(g, x - 1, y) && !pathOpen(g, x - 1, y - dy)) ||
+                 (pathOpen(g, x + 1, y) && !pathOpen(g, x + 1, y - dy))) {
+            break;
+        }
+
+        x += dx;
+        y += dy;
+    }
+
+    found->x = x;
+    found->y = y;
+
+    return TRUE;
+}
+
+// Only the directions a jump point can lead on to: straight and diagonally
+// ahead, and to either side, which a corner-free straight move can't prune.
+static int pathJumpDirections(const pathGrid* g, int x, int y, int dx, int dy, int* directions) {
+    int count = 0;
+
+    for (int d = 0; d < 8; d++) {
+        int ex = pathDx[d];
+        int ey = pathDy[d];
+        bool ahead;
+
+        if (dx != 0 && dy != 0) {
+            ahead = (ex == dx || ex == 0) && (ey == dy || ey == 0);
+        }
+        else if (dx != 0) {
+            ahead = ex == dx || ex == 0;
+        }
+        else {
+            ahead = ey == dy || ey == 0;
+        }
+
+        if (ahead && pathStep(g, x, y, ex, ey)) {
+            directions[count++] = d;
+        }
+    }
+
+    return count;
+}
+
+static bool pathExpand(const pathGrid* g, pathSearch* s, int cell, SDL_Point goal, bool jump) {
+    int x = cell % g->columns;
+    int y = cell / g->columns;
+    int directions[8];
+    int count = 0;
+
+    if (jump && s->parents[cell] >= 0) {
+        int px = s->parents[cell] % g->columns;
+        int py = s->parents[cell] / g->columns;
+
+        count = pathJumpDirections(g, x, y, SDL_clamp(x - px, -1, 1), SDL_clamp(y - py, -1, 1), directions);
+    }
+    else {
+        int mask = pathNeighbours(g, x, y);
+
+        for (int d = 0; d < 8; d++) {
+            if (mask & (1 << d)) {
+                directions[count++] = d;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        int dx = pathDx[directions[i]];
+        int dy = pathDy[directions[i]];
+        SDL_Point next = { x + dx, y + dy };
+        float cost;
+
+        if (jump) {
+            if (!pathJump(g, next.x, next.y, dx, dy, goal, &next)) {
+                continue;
+            }
+
+            cost = s->costs[cell] + pathOctile(x, y, next.x, next.y);
+        }
+        else {
+            cost = s->costs[cell] + (dx != 0 && dy != 0 ? PATH_SQRT2 : 1.0f) * g->costs[next.y * g->columns + next.x];
+        }
+
+        if (!pathVisit(s, next.y * g->columns + next.x, cell, cost, cost + pathOctile(next.x, next.y, goal.x, goal.y))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// Fills points from the goal backwards, so each straight or diagonal run
+// between jump points comes out as the cells it crosses.
+static int pathTrace(const pathGrid* g, const pathSearch* s, int goal, SDL_Point* points, int capacity) {
+    int length = 1;
+
+    for (int cell = goal; s->parents[cell] >= 0; cell = s->parents[cell]) {
+        int parent = s->parents[cell];
+
+        length += SDL_max(abs(cell % g->columns - parent % g->columns), abs(cell / g->columns - parent / g->columns));
+    }
+
+    int at = length - 1;
+
+    for (int cell = goal; cell >= 0; cell = s->parents[cell]) {
+        int x = cell % g->columns;
+        int y = cell / g->columns;
+        int parent = s->parents[cell];
+        int dx = parent >= 0 ? SDL_clamp(parent % g->columns - x, -1, 1) : 0;
+        int dy = parent >= 0 ? SDL_clamp(parent / g->columns - y, -1, 1) : 0;
+
+        do {
+            if (points && at < capacity) {
+                points[at] = (SDL_Point){ x, y };
+            }
+
+            at--;
+            x += dx;
+            y += dy;
+        } while (parent >= 0 && y * g->columns + x != parent);
+    }
+
+    return length;
+}
+
+static int pathSearchRun(pathGrid* g, SDL_Point start, SDL_Point goal, SDL_Point* points, int capacity) {
+    if (!g || !pathOpen(g, start.x, start.y) || !pathOpen(g, goal.x, goal.y)) {
+        return -1;
+    }
+
+    pathSearch* s = pathSearchAcquire(g);
+    int target = goal.y * g->columns + goal.x;
+    bool jump = g->weighted == 0;
+    int length = -1;
+
+    if (!s) {
+        return -1;
+    }
+
+    if (pathVisit(s, start.y * g->columns + start.x, -1, 0, pathOctile(start.x, start.y, goal.x, goal.y))) {
+        while (s->heapCount > 0) {
+            int cell = pathPop(s).cell;
+
+            if (s->marks[cell] != s->stamp) {
+                continue;
+            }
+
+            if (cell == target) {
+                length = pathTrace(g, s, cell, points, capacity);
+                break;
+            }
+
+            s->marks[cell] = s->stamp + 1;
+
+            if (!pathExpand(g, s, cell, goal, jump)) {
+                break;
+            }
+        }
+    }
+
+    pathSearchRelease(g, s);
+
+    return length;
+}
+
+int pathFind(pathGrid* g, SDL_Point start, SDL_Point goal, SDL_Point* points, int capacity) {
+    return pathSearchRun(g, start, goal, points, capacity);
+}
+
+static void pathBatchRun(void* data, int index) {
+    pathBatch* batch = data;
+    pathRequest* r = &batch->requests[index];
+
+    r->count = pathSearchRun(batch->grid, r->start, r->goal, r->points, r->capacity);
+}
+
+void pathFindMany(pathGrid* g, pathRequest* requests, int count) {
+    pathBatch batch = { g, requests };
+
+    if (requests) {
+        jobsRun(pathBatchRun, &batch, count);
+    }
+}
+
+pathField* pathFieldCreate(pathGrid* g) {
+    if (!g) {
+        return NULL;
+    }
+
+    pathField* f = memoryAlloc(MEMORY_GAME, sizeof(pathField));
+
+    if (!f) {
+        return NULL;
+    }
+
+    f->distances = memoryAlloc(MEMORY_GAME, (size_t)g->columns * g->rows * sizeof(float));
+
+    if (!f->distances) {
+        memoryFree(f);
+        return NULL;
+    }
+
+    for (int i = 0; i < g->columns * g->rows; i++) {
+        f->distances[i] = INFINITY;
+    }
+
+    f->grid = g;
+    f->goal = (SDL_Point){ -1, -1 };
+
+    return f;
+}
+
+void pathFieldDestroy(pathField* f) {
+    if (f) {
+        memoryFree(f->distances);
+        memoryFree(f);
+    }
+}
+
+// Dijkstra outwards from the goal. Stepping from a cell into a neighbour costs
+// the neighbour's cost, so a cell's distance is the cheapest way to the goal.
+bool pathFieldBuild(pathField* f, SDL_Point goal) {
+    if (!f || !pathOpen(f->grid, goal.x, goal.y)) {
+        return FALSE;
+    }
+
+    pathGrid* g = f->grid;
+    pathSearch* s = pathSearchAcquire(g);
+
+    for (int i = 0; i < g->columns * g->rows; i++) {
+        f->distances[i] = INFINITY;
+    }
+
+    f->goal = goal;
+    f->distances[goal.y * g->columns + goal.x] = 0;
+
+    if (!s) {
+        return FALSE;
+    }
+
+    bool built = pathPush(s, goal.y * g->columns + goal.x, 0);
+
+    while (built && s->heapCount > 0) {
+        pathNode node = pathPop(s);
+        int x = node.cell % g->columns;
+        int y = node.cell / g->columns;
+        float step = g->costs[node.cell];
+
+        if (node.priority > f->distances[node.cell]) {
+            continue;
+        }
+
+        int mask = pathNeighbours(g, x, y);
+
+        for (int d = 0; d < 8 && built; d++) {
+            int cell = (y + pathDy[d]) * g->columns + x + pathDx[d];
+            float distance = node.priority + (d >= 4 ? PATH_SQRT2 : 1.0f) * step;
+
+            if ((mask & (1 << d)) && distance < f->distances[cell]) {
+                f->distances[cell] = distance;
+                built = pathPush(s, cell, distance);
+            }
+        }
+    }
+
+    pathSearchRelease(g, s);
+
+    return built;
+}
+
+float pathFieldDistance(const pathField* f, int x, int y) {
+    if (!f || x < 0 || y < 0 || x >= f->grid->columns || y >= f->grid->rows) {
+        return -1;
+    }
+
+    float distance = f->distances[y * f->grid->columns + x];
+
+    return isinf(distance) ? -1 : distance;
+}
+
+vector2 pathFieldDirection(const pathField* f, int x, int y) {
+    vector2 direction = vectorZero();
+    float best = INFINITY;
+
+    if (pathFieldDistance(f, x, y) <= 0) {
+        return direction;
+    }
+
+    const pathGrid* g = f->grid;
+    int mask = pathNeighbours(g, x, y);
+
+    for (int d = 0; d < 8; d++) {
+        if (!(mask & (1 << d))) {
+            continue;
+        }
+
+        int cell = (y + pathDy[d]) * g->columns + x + pathDx[d];
+        float step = d >= 4 ? PATH_SQRT2 : 1.0f;
+        float distance = f->distances[cell] + step * g->costs[cell];
+
+        if (distance < best) {
+            best = distance;
+            direction = (vector2){ pathDx[d] / step, pathDy[d] / step };
+        }
+    }
+
+    return direction;
+}
+
+// Particles
+
+// Shaders
+
+#define POST_MAX_EFFECTS 8
+#define POST_BAND_ROWS 16
+#define POST_LUT_SIZE 33
+
+typedef enum postEffectType {
+    POST_BLUR,
+    POST_BLOOM,
+    POST_LUT,
+    POST_VIGNETTE
+} postEffectType;
+
+typedef struct postEffect {
+    postEffectType type;
+    float radius;
+    float threshold;
+    float intensity;
+    Uint16* lut;
+    Uint16* mask;
+    int maskWidth;
+    int maskHeight;
+    double milliseconds;
+} postEffect;
+
+typedef struct postEdit {
+    postEffect effect;
+    int index;
+    int scale;
+} postEdit;
+
+typedef struct postPass {
+    Uint32* source;
+    Uint32* target;
+    int width;
+    int height;
+    int smallWidth;
+    int smallHeight;
+    int radius;
+    int threshold;
+    int intensity;
+    const postEffect* effect;
+} postPass;
+
+static postEffect postChain[POST_MAX_EFFECTS];
+static int postCount;
+static int postScale = 2;
+static bool postActive;
+static SDL_Texture* postTarget;
+static SDL_Texture* postOutput;
+static Uint32* postPixels;
+static Uint32* postSmall;
+static Uint32* postTemp;
+static int postWidth;
+static int postHeight;
+static int postSmallCapacity;
+
+static const char* const postEffectNames[] = { "post blur", "post bloom", "post lut", "post vignette" };
+
+// The chain is read by postProcess on the render thread, so edits made from
+// the update thread in pipelined mode are run there between frames.
+static void postAddTask(void* data) {
+    postEdit* edit = data;
+
+    if (postCount == POST_MAX_EFFECTS) {
+        edit->index = -1;
+        return;
+    }
+
+    postChain[postCount] = edit->effect;
+    edit->index = postCount++;
+}
+
+static int postAdd(postEffectType type, float radius, float threshold, float intensity, Uint16* lut) {
+    postEdit edit;
+
+    SDL_zero(edit);
+    edit.effect.type = type;
+    edit.effect.radius = radius;
+    edit.effect.threshold = threshold;
+    edit.effect.intensity = intensity;
+    edit.effect.lut = lut;
+    renderThreadCall(postAddTask, &edit);
+
+    return edit.index;
+}
+
+int postAddBlur(float radius) {
+    return radius > 0 ? postAdd(POST_BLUR, radius, 0, 0, NULL) : -1;
+}
+
+int postAddBloom(float threshold, float intensity, float radius) {
+    return radius > 0 ? postAdd(POST_BLOOM, radius, SDL_clamp(threshold, 0.0f, 0.99f), intensity, NULL) : -1;
+}
+
+int postAddVignette(float strength, float radius) {
+    return postAdd(POST_VIGNETTE, SDL_clamp(radius, 0.0f, 1.0f), 0, SDL_clamp(strength, 0.0f, 1.0f), NULL);
+}
+
+static float postLUTChannel(const color* lut, int size, float r, float g, float b, int channel) {
+    int r0 = (int)r, g0 = (int)g, b0 = (int)b;
+    int r1 = SDL_min(r0 + 1, size - 1), g1 = SDL_min(g0 + 1, size - 1), b1 = SDL_min(b0 + 1, size - 1);
+    float tr = r - r0, tg = g - g0, tb = b - b0;
+    float corners[8];
+    int index[8] = {
+        (b0 * size + g0) * size + r0, (b0 * size + g0) * size + r1,
+        (b0 * size + g1) * size + r0, (b0 * size + g1) * size + r1,
+        (b1 * size + g0) * size + r0, (b1 * size + g0) * size + r1,
+        (b1 * size + g1) * size + r0, (b1 * size + g1) * size + r1
+    };
+
+    for (int i = 0; i < 8; i++) {
+        const color* c = &lut[index[i]];
+        corners[i] = channel == 0 ? c->r : channel == 1 ? c->g : c->b;
+    }
+
+    float g0v = lerpf(lerpf(corners[0], corners[1], tr), lerpf(corners[2], corners[3], tr), tg);
+    float g1v = lerpf(lerpf(corners[4], corners[5], tr), lerpf(corners[6], corners[7], tr), tg);
+
+    return lerpf(g0v, g1v, tb);
+}
+
+int postAddLUT(const color* lut, int size) {
+    if (!lut || size < 2) {
+        return -1;
+    }
+
+    Uint16* table = memoryAlloc(MEMORY_RENDER, POST_LUT_SIZE * POST_LUT_SIZE * POST_LUT_SIZE * 3 * sizeof(Uint16));
+
+    if (!table) {
+        return -1;
+    }
+
+    float step = (float)(size - 1) / (POST_LUT_SIZE - 1);
+
+    for (int b = 0; b < POST_LUT_SIZE; b++) {
+        for (int g = 0; g < POST_LUT_SIZE; g++) {
+            for (int r = 0; r < POST_LUT_SIZE; r++) {
+                Uint16* entry = table + ((r * POST_LUT_SIZE + g) * POST_LUT_SIZE + b) * 3;
+
+                for (int channel = 0; channel < 3; channel++) {
+                    float value = postLUTChannel(lut, size, r * step, g * step, b * step, channel);
+                    entry[channel] = (Uint16)SDL_clamp(value * 256 + 0.5f, 0.0f, 65535.0f);
+                }
+            }
+        }
+    }
+
+    int index = postAdd(POST_LUT, 0, 0, 0, table);
+
+    if (index < 0) {
+        memoryFree(table);
+    }
+
+    return index;
+}
+
+static void postClearTask(void* data) {
+    (void)data;
+
+    for (int i = 0; i < postCount; i++) {
+        memoryFree(postChain[i].lut);
+        memoryFree(postChain[i].mask);
+    }
+
+    SDL_zeroa(postChain);
+    postCount = 0;
+}
+
+void postClear(void) {
+    renderThreadCall(postClearTask, NULL);
+}
+
+static void postScaleTask(void* data) {
+    postScale = ((postEdit*)data)->scale;
+}
+
+void setPostScale(int divisor) {
+    postEdit edit;
+
+    SDL_zero(edit);
+    edit.scale = SDL_clamp(divisor, 1, 8);
+    renderThreadCall(postScaleTask, &edit);
+}
+
+static void postTimeTask(void* data) {
+    postEdit* edit = data;
+
+    if (edit->index >= 0 && edit->index < postCount) {
+        edit->effect.milliseconds = postChain[edit->index].milliseconds;
+    }
+}
+
+double postEffectTime(int index) {
+    postEdit edit;
+
+    SDL_zero(edit);
+    edit.index = index;
+    renderThreadCall(postTimeTask, &edit);
+
+    return edit.effect.milliseconds;
+}
+
+static void postDownsample(void* data, int band) {
+    const postPass* pass = data;
+    int scale = postScale;
+    int count = scale * scale;
+    int y1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->smallHeight);
+
+    for (int y = band * POST_BAND_ROWS; y < y1; y++) {
+        Uint32* out = pass->target + (size_t)y * pass->smallWidth;
+
+        for (int x = 0; x < pass->smallWidth; x++) {
+            int sum[3] = { 0, 0, 0 };
+
+            for (int v = 0; v < scale; v++) {
+                const Uint32* in = pass->source + (size_t)(y * scale + v) * pass->width + x * scale;
+
+                for (int u = 0; u < scale; u++) {
+                    sum[0] += (in[u] >> 16) & 0xFF;
+                    sum[1] += (in[u] >> 8) & 0xFF;
+                    sum[2] += in[u] & 0xFF;
+                }
+            }
+
+            for (int c = 0; c < 3; c++) {
+                sum[c] = (sum[c] + count / 2) / count;
+
+                if (pass->threshold > 0) {
+                    sum[c] = SDL_max(sum[c] - pass->threshold, 0) * 255 / (255 - pass->threshold);
+                }
+            }
+
+            out[x] = 0xFF000000u | ((Uint32)sum[0] << 16) | ((Uint32)sum[1] << 8) | (Uint32)sum[2];
+        }
     }
 }
 
-bool entityIsActive(const entity *e) {
-    return e->isActive;
+static void postBoxBlur(const Uint32* in, Uint32* out, int count, int stride, int radius) {
+    Uint32 sum[3] = { 0, 0, 0 };
+    Uint32 reciprocal = (65536 + 2 * radius) / (2 * radius + 1);
+
+    for (int i = -radius; i <= radius; i++) {
+        Uint32 p = in[SDL_clamp(i, 0, count - 1) * stride];
+        sum[0] += (p >> 16) & 0xFF;
+        sum[1] += (p >> 8) & 0xFF;
+        sum[2] += p & 0xFF;
+    }
+
+    for (int i = 0; i < count; i++) {
+        out[i * stride] = 0xFF000000u | (((sum[0] * reciprocal) >> 16) << 16) | (((sum[1] * reciprocal) >> 16) << 8) | ((sum[2] * reciprocal) >> 16);
+
+        Uint32 leaving = in[SDL_max(i - radius, 0) * stride];
+        Uint32 entering = in[SDL_min(i + radius + 1, count - 1) * stride];
+
+        sum[0] += ((entering >> 16) & 0xFF) - ((leaving >> 16) & 0xFF);
+        sum[1] += ((entering >> 8) & 0xFF) - ((leaving >> 8) & 0xFF);
+        sum[2] += (entering & 0xFF) - (leaving & 0xFF);
+    }
 }
 
-bool entityCompare(const entity *a, const entity *b) {
-    return a->id == b->id &&
-           a->position.x == b->position.x &&
-           a->position.y == b->position.y &&
-           a->isActive == b->isActive;
+static void postBlurRows(void* data, int band) {
+    const postPass* pass = data;
+    int y1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->smallHeight);
+
+    for (int y = band * POST_BAND_ROWS; y < y1; y++) {
+        postBoxBlur(pass->source + (size_t)y * pass->smallWidth, pass->target + (size_t)y * pass->smallWidth, pass->smallWidth, 1, pass->radius);
+    }
 }
 
-// Primitives
+static void postBlurColumns(void* data, int band) {
+    const postPass* pass = data;
+    int x1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->smallWidth);
 
-primitive newRectangle(vector2 position, float width, float height, color color) {
-    entity e = entityInit(rand(), vectorZero());
-    primitive p;
-    p.base = e;
-    p.type = RECTANGLE;
-    p.color = color;
-    p.base.position = position;
-    p.rectangle.width = width;
-    p.rectangle.height = height;
-    return p;
+    for (int x = band * POST_BAND_ROWS; x < x1; x++) {
+        postBoxBlur(pass->source + x, pass->target + x, pass->smallHeight, pass->smallWidth, pass->radius);
+    }
 }
 
-primitive newCircle(vector2 position, float radius, int segments, color color) {
-    entity e = entityInit(rand(), vectorZero());
-    primitive p;
-    p.base = e;
-    p.type = CIRCLE;
-    p.color = color;
-    p.base.position = position;
-    p.circle.radius = radius;
-    p.circle.segments = segments;
-    return p;
+static Uint32 postSample(const postPass* pass, int x, int y) {
+    int fx = SDL_max(((2 * x + 1) * 128) / postScale - 128, 0);
+    int fy = SDL_max(((2 * y + 1) * 128) / postScale - 128, 0);
+    int x0 = SDL_min(fx >> 8, pass->smallWidth - 1);
+    int y0 = SDL_min(fy >> 8, pass->smallHeight - 1);
+    int x1 = SDL_min(x0 + 1, pass->smallWidth - 1);
+    int y1 = SDL_min(y0 + 1, pass->smallHeight - 1);
+    Uint32 tx = fx & 0xFF;
+    Uint32 ty = fy & 0xFF;
+    const Uint32* row0 = postSmall + (size_t)y0 * pass->smallWidth;
+    const Uint32* row1 = postSmall + (size_t)y1 * pass->smallWidth;
+    Uint32 result = 0xFF000000u;
+
+    for (int shift = 0; shift < 24; shift += 8) {
+        Uint32 top = ((row0[x0] >> shift) & 0xFF) * (256 - tx) + ((row0[x1] >> shift) & 0xFF) * tx;
+        Uint32 bottom = ((row1[x0] >> shift) & 0xFF) * (256 - tx) + ((row1[x1] >> shift) & 0xFF) * tx;
+
+        result |= (((top * (256 - ty) + bottom * ty) >> 16) & 0xFF) << shift;
+    }
+
+    return result;
 }
 
-primitive newTriangle(vector2 position, float base, float height, float skew, color color) {
-    entity e = entityInit(rand(), vectorZero());
-    primitive p;
-    p.base = e;
-    p.type = TRIANGLE;
-    p.color = color;
-    p.base.position = position;
-    p.triangle.base = base;
-    p.triangle.height = height;
-    p.triangle.skew = skew;
-    return p;
+static Uint32 postScaleColor(Uint32 c, int scale) {
+    Uint32 rb = (((c & 0xFF00FF) * scale) >> 8) & 0xFF00FF;
+    Uint32 g = (((c & 0x00FF00) * scale) >> 8) & 0x00FF00;
+    return rb | g;
 }
 
-primitive newLine(vector2 pointA, vector2 pointB, float width, color color) {
-    entity e = entityInit(rand(), vectorZero());
-    primitive p;
-    p.base = e;
-    p.type = LINE;
-    p.color = color;
-    p.base.position = pointA;
-    p.line.endPoint = pointB;
-    p.line.width = width;
-    return p;
+static Uint32 postGlow(Uint32 c, int scale) {
+    Uint32 r = SDL_min((((c >> 16) & 0xFF) * scale) >> 8, 255u);
+    Uint32 g = SDL_min((((c >> 8) & 0xFF) * scale) >> 8, 255u);
+    Uint32 b = SDL_min(((c & 0xFF) * scale) >> 8, 255u);
+    return (r << 16) | (g << 8) | b;
 }
 
-void drawPrimitive(primitive* p) {
-    switch (p->type) {
-        case RECTANGLE: {
-            SDL_Rect rect = {
-                (int)p->base.position.x, 
-                (int)p->base.position.y,
-                (int)p->rectangle.width,
-                (int)p->rectangle.height
-            };
-            SDL_SetRenderDrawColor(initializedNest->renderer,
-                                   p->color.r,
-                                   p->color.g,
-                                   p->color.b,
-                                   255);
-            SDL_RenderDrawRect(initializedNest->renderer, &rect);
-            break;
-        }
-        
-        case CIRCLE: {
-            int cx = (int)p->base.position.x;
-            int cy = (int)p->base.position.y;
-            int radius = (int)p->circle.radius;
-            
-            SDL_SetRenderDrawColor(initializedNest->renderer,
-                                   p->color.r,
-                                   p->color.g,
-                                   p->color.b,
-                                   255);
-            
-            for (int i = 0; i < p->circle.segments; i++) {
-                float angle1 = 2.0f * 3.14159f * i / p->circle.segments;
-                float angle2 = 2.0f * 3.14159f * (i + 1) / p->circle.segments;
-                
-                int x1 = (int)(cx + radius * cos(angle1));
-                int y1 = (int)(cy + radius * sin(angle1));
-                int x2 = (int)(cx + radius * cos(angle2));
-                int y2 = (int)(cy + radius * sin(angle2));
-                
-                SDL_RenderDrawLine(initializedNest->renderer, x1, y1, x2, y2);
+static void postUpsample(void* data, int band) {
+    const postPass* pass = data;
+    int y1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->height);
+
+    for (int y = band * POST_BAND_ROWS; y < y1; y++) {
+        Uint32* row = pass->source + (size_t)y * pass->width;
+        int x = 0;
+
+        if (pass->intensity < 0) {
+            for (; x < pass->width; x++) {
+                row[x] = postSample(pass, x, y);
             }
-            break;
-        }
-        
-        case TRIANGLE: {
-            SDL_Point points[3] = {
-                { (int)p->base.position.x, (int)p->base.position.y },
-                { (int)(p->base.position.x + p->triangle.base), (int)p->base.position.y },
-                { (int)(p->base.position.x + p->triangle.base / 2 + p->triangle.skew), (int)(p->base.position.y - p->triangle.height) }
-            };
-            
-            SDL_SetRenderDrawColor(initializedNest->renderer,
-                                   p->color.r,
-                                   p->color.g,
-                                   p->color.b,
-                                   255);
-            
-            SDL_RenderDrawLines(initializedNest->renderer, points, 3);
-            SDL_RenderDrawLine(initializedNest->renderer, points[2].x, points[2].y, points[0].x, points[0].y);
-            break;
+
+            continue;
         }
-        
-        case LINE: {
-            SDL_SetRenderDrawColor(initializedNest->renderer,
-                                   p->color.r,
-                                   p->color.g,
-                                   p->color.b,
-                                   255);
-            SDL_RenderDrawLine(initializedNest->renderer,
-                               (int)p->base.position.x,
-                               (int)p->base.position.y,
-                               (int)p->line.endPoint.x,
-                               (int)p->line.endPoint.y);
-            break;
+
+#ifdef __SSE2__
+        for (; x + 4 <= pass->width; x += 4) {
+            Uint32 glow[4];
+
+            for (int i = 0; i < 4; i++) {
+                glow[i] = postGlow(postSample(pass, x + i, y), pass->intensity);
+            }
+
+            __m128i d = _mm_loadu_si128((const __m128i*)(row + x));
+            _mm_storeu_si128((__m128i*)(row + x), _mm_adds_epu8(d, _mm_loadu_si128((const __m128i*)glow)));
         }
+#endif
 
-        default:
-            break;
+        for (; x < pass->width; x++) {
+            Uint32 glow = postGlow(postSample(pass, x, y), pass->intensity);
+            Uint32 d = row[x];
+            Uint32 r = SDL_min(((d >> 16) & 0xFF) + ((glow >> 16) & 0xFF), 255u);
+            Uint32 g = SDL_min(((d >> 8) & 0xFF) + ((glow >> 8) & 0xFF), 255u);
+            Uint32 b = SDL_min((d & 0xFF) + (glow & 0xFF), 255u);
+
+            row[x] = (d & 0xFF000000u) | (r << 16) | (g << 8) | b;
+        }
     }
 }
 
-// Textures
+static int postLerp(int a, int b, int weight) {
+    return (a * (256 - weight) + b * weight) >> 8;
+}
 
-texture textureLoad(char const *path) {
-    SDL_Texture* t = NULL;
-    SDL_Surface* s = IMG_Load(path);
-    
-    if (!s) {
-        return NULL;
+static int postTrilinear(const Uint16* t, int wr, int wg, int wb) {
+    const int dr = POST_LUT_SIZE * POST_LUT_SIZE * 3;
+    const int dg = POST_LUT_SIZE * 3;
+    const int db = 3;
+    int c00 = postLerp(t[0], t[db], wb);
+    int c01 = postLerp(t[dg], t[dg + db], wb);
+    int c10 = postLerp(t[dr], t[dr + db], wb);
+    int c11 = postLerp(t[dr + dg], t[dr + dg + db], wb);
+
+    return SDL_min((postLerp(postLerp(c00, c01, wg), postLerp(c10, c11, wg), wr) + 128) >> 8, 255);
+}
+
+// The table holds 8.8 fixed-point colors on a 33^3 grid, and each pixel is
+// filtered between the eight entries around it so grading keeps all 8 bits.
+static void postGrade(void* data, int band) {
+    const postPass* pass = data;
+    const Uint16* lut = pass->effect->lut;
+    int y1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->height);
+    int cells[256];
+    int weights[256];
+
+    for (int c = 0; c < 256; c++) {
+        int scaled = c * (POST_LUT_SIZE - 1);
+
+        cells[c] = SDL_min(scaled / 255, POST_LUT_SIZE - 2);
+        weights[c] = ((scaled - cells[c] * 255) * 256 + 127) / 255;
     }
 
-    t = SDL_CreateTextureFromSurface(initializedNest->renderer, s);
-    SDL_FreeSurface(s);
+    for (int y = band * POST_BAND_ROWS; y < y1; y++) {
+        Uint32* row = pass->source + (size_t)y * pass->width;
 
-    if (!t) {
-        return NULL;
+        for (int x = 0; x < pass->width; x++) {
+            Uint32 p = row[x];
+            int r = (p >> 16) & 0xFF;
+            int g = (p >> 8) & 0xFF;
+            int b = p & 0xFF;
+            const Uint16* t = lut + ((cells[r] * POST_LUT_SIZE + cells[g]) * POST_LUT_SIZE + cells[b]) * 3;
+
+            row[x] = 0xFF000000u | ((Uint32)postTrilinear(t, weights[r], weights[g], weights[b]) << 16) |
+                     ((Uint32)postTrilinear(t + 1, weights[r], weights[g], weights[b]) << 8) |
+                     (Uint32)postTrilinear(t + 2, weights[r], weights[g], weights[b]);
+        }
     }
+}
 
-    return t;
+static void postVignette(void* data, int band) {
+    const postPass* pass = data;
+    const Uint16* mask = pass->effect->mask;
+    int y1 = SDL_min((band + 1) * POST_BAND_ROWS, pass->height);
+
+    for (int y = band * POST_BAND_ROWS; y < y1; y++) {
+        Uint32* row = pass->source + (size_t)y * pass->width;
+        const Uint16* weights = mask + (size_t)y * pass->width;
+        int x = 0;
+
+#ifdef __SSE2__
+        __m128i zero = _mm_setzero_si128();
+        __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+
+        for (; x + 4 <= pass->width; x += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i lo = _mm_unpacklo_epi8(d, zero);
+            __m128i hi = _mm_unpackhi_epi8(d, zero);
+            __m128i w0 = _mm_set_epi16(weights[x + 1], weights[x + 1], weights[x + 1], weights[x + 1],
+                                       weights[x], weights[x], weights[x], weights[x]);
+            __m128i w1 = _mm_set_epi16(weights[x + 3], weights[x + 3], weights[x + 3], weights[x + 3],
+                                       weights[x + 2], weights[x + 2], weights[x + 2], weights[x + 2]);
+
+            lo = _mm_srli_epi16(_mm_mullo_epi16(lo, w0), 8);
+            hi = _mm_srli_epi16(_mm_mullo_epi16(hi, w1), 8);
+            __m128i shaded = _mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi));
+            _mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(shaded, _mm_and_si128(d, alpha)));
+        }
+#endif
+
+        for (; x < pass->width; x++) {
+            row[x] = (row[x] & 0xFF000000u) | postScaleColor(row[x], weights[x]);
+        }
+    }
 }
 
-bool textureBind(entity* e, texture t)
-{
-    if (!t) {
+static bool postVignetteMask(postEffect* e, int width, int height) {
+    if (e->mask && e->maskWidth == width && e->maskHeight == height) {
+        return TRUE;
+    }
+
+    Uint16* mask = memoryRealloc(MEMORY_RENDER, e->mask, (size_t)width * height * sizeof(Uint16));
+
+    if (!mask) {
         return FALSE;
     }
 
-    e->tex = t;
+    float cx = width * 0.5f;
+    float cy = height * 0.5f;
+    float reach = sqrtf(cx * cx + cy * cy);
 
-    int w, h;
-    SDL_QueryTexture(e->tex, NULL, NULL, &w, &h);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float dx = x + 0.5f - cx;
+            float dy = y + 0.5f - cy;
+            float d = sqrtf(dx * dx + dy * dy) / reach;
+            float t = SDL_clamp((d - e->radius) / SDL_max(1.0f - e->radius, 0.0001f), 0.0f, 1.0f);
 
-    SDL_Rect r;
-    r.x = e->position.x;
-    r.y = e->position.y;
-    r.w = w;
-    r.h = h;
+            mask[(size_t)y * width + x] = (Uint16)(256.0f * (1.0f - e->intensity * t * t * (3 - 2 * t)));
+        }
+    }
 
-    SDL_RenderCopy(initializedNest->renderer, e->tex, NULL, &r);
+    e->mask = mask;
+    e->maskWidth = width;
+    e->maskHeight = height;
 
     return TRUE;
 }
 
-void textureUnbind(entity* e) {
-    if (e->tex != NULL) {
-        SDL_DestroyTexture(e->tex);
-        e->tex = NULL;
+static void postBlur(postPass* pass, float radius) {
+    pass->radius = SDL_clamp((int)(radius / postScale + 0.5f), 1, 127);
+
+    for (int i = 0; i < 2; i++) {
+        pass->source = postSmall;
+        pass->target = postTemp;
+        jobsRun(postBlurRows, pass, (pass->smallHeight + POST_BAND_ROWS - 1) / POST_BAND_ROWS);
+
+        pass->source = postTemp;
+        pass->target = postSmall;
+        jobsRun(postBlurColumns, pass, (pass->smallWidth + POST_BAND_ROWS - 1) / POST_BAND_ROWS);
     }
 }
 
-// Animations
+static void postProcess(Uint32* pixels, int width, int height) {
+    int smallWidth = SDL_max(width / postScale, 1);
+    int smallHeight = SDL_max(height / postScale, 1);
+    int bands = (height + POST_BAND_ROWS - 1) / POST_BAND_ROWS;
 
-// Collision
+    if (postCount == 0) {
+        return;
+    }
 
-// Gravity
+    if (smallWidth * smallHeight > postSmallCapacity) {
+        Uint32* small = memoryRealloc(MEMORY_RENDER, postSmall, (size_t)smallWidth * smallHeight * sizeof(Uint32));
+        Uint32* temp = small ? memoryRealloc(MEMORY_RENDER, postTemp, (size_t)smallWidth * smallHeight * sizeof(Uint32)) : NULL;
 
-// Camera
+        if (small) {
+            postSmall = small;
+        }
 
-// Input
+        if (!temp) {
+            return;
+        }
 
-// Audio
+        postTemp = temp;
+        postSmallCapacity = smallWidth * smallHeight;
+    }
 
-// Particles
+    for (int i = 0; i < postCount; i++) {
+        postEffect* e = &postChain[i];
+        Uint64 start = SDL_GetPerformanceCounter();
+        postPass pass;
+
+        SDL_zero(pass);
+        pass.width = width;
+        pass.height = height;
+        pass.smallWidth = smallWidth;
+        pass.smallHeight = smallHeight;
+        pass.effect = e;
+        traceBegin(postEffectNames[e->type]);
+
+        switch (e->type) {
+            case POST_BLUR:
+            case POST_BLOOM:
+                pass.source = pixels;
+                pass.target = postSmall;
+                pass.threshold = e->type == POST_BLOOM ? (int)(e->threshold * 255) : 0;
+                jobsRun(postDownsample, &pass, (smallHeight + POST_BAND_ROWS - 1) / POST_BAND_ROWS);
+
+                postBlur(&pass, e->radius);
+
+                pass.source = pixels;
+                pass.intensity = e->type == POST_BLOOM ? (int)(SDL_clamp(e->intensity, 0.0f, 16.0f) * 256) : -1;
+                jobsRun(postUpsample, &pass, bands);
+                break;
+
+            case POST_LUT:
+                pass.source = pixels;
+                jobsRun(postGrade, &pass, bands);
+                break;
+
+            case POST_VIGNETTE:
+                if (postVignetteMask(e, width, height)) {
+                    pass.source = pixels;
+                    jobsRun(postVignette, &pass, bands);
+                }
+                break;
+        }
+
+        traceEnd(postEffectNames[e->type]);
+        e->milliseconds = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    }
+}
+
+static void postBegin(void) {
+    SDL_Renderer* renderer = initializedNest->renderer;
+    int w = 0;
+    int h = 0;
+
+    postActive = FALSE;
+
+    if (postCount == 0 || rasterMode || dirtyRectMode || !SDL_RenderTargetSupported(renderer)) {
+        return;
+    }
+
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    if (w != postWidth || h != postHeight || !postTarget) {
+        Uint32* pixels = memoryRealloc(MEMORY_RENDER, postPixels, (size_t)w * h * sizeof(Uint32));
+
+        if (!pixels) {
+            return;
+        }
 
-// Shaders
\ No newline at end of file
+        postPixels = pixels;
+
+        if (postTarget) {
+            memoryDestroyTexture(postTarget);
+        }
+
+        if (postOutput) {
+            memoryDestroyTexture(postOutput);
+        }
+
+        postTarget = memoryTexture(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h));
+        postOutput = memoryTexture(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h));
+        postWidth = w;
+        postHeight = h;
+    }
+
+    if (postTarget && postOutput && SDL_SetRenderTarget(renderer, postTarget) == 0) {
+        postActive = TRUE;
+    }
+}
+
+static void postEnd(void) {
+    SDL_Renderer* renderer = initializedNest->renderer;
+
+    if (!postActive) {
+        return;
+    }
+
+    postActive = FALSE;
+
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, postPixels, postWidth * sizeof(Uint32)) == 0) {
+        postProcess(postPixels, postWidth, postHeight);
+        SDL_UpdateTexture(postOutput, NULL, postPixels, postWidth * sizeof(Uint32));
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderCopy(renderer, postOutput, NULL, NULL);
+    }
+    else {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderCopy(renderer, postTarget, NULL, NULL);
+    }
+}
+
+static void postsInvalidate(bool deviceLost) {
+    if (deviceLost) {
+        if (postTarget) {
+            memoryDestroyTexture(postTarget);
+        }
+
+        if (postOutput) {
+            memoryDestroyTexture(postOutput);
+        }
+
+        postTarget = NULL;
+        postOutput = NULL;
+    }
+}
+
+static void postsFree(void) {
+    postClear();
+
+    if (postTarget) {
+        memoryDestroyTexture(postTarget);
+    }
+
+    if (postOutput) {
+        memoryDestroyTexture(postOutput);
+    }
+
+    memoryFree(postPixels);
+    memoryFree(postSmall);
+    memoryFree(postTemp);
+    postTarget = postOutput = NULL;
+    postPixels = postSmall = postTemp = NULL;
+    postWidth = postHeight = postSmallCapacity = 0;
+}
@@ -10,14 +10,42 @@ typedef enum bool {
     TRUE = 1
 } bool;
 
+// Trace names are kept by pointer until traceClose. Leaving a TRACE_ZONE via break or return loses its end.
+bool traceOpen(const char* path);
+void traceClose(void);
+void traceBegin(const char* name);
+void traceEnd(const char* name);
+void traceInstant(const char* name);
+void traceCounter(const char* name, double value);
+void traceMessage(const char* format, ...);
+
+#define TRACE_ZONE(name) for (int traceZone_ = (traceBegin(name), 1); traceZone_; traceZone_ = (traceEnd(name), 0))
+
+// Colors share SDL_Color's byte order; COLOR_HEX and COLOR_HEXA fold to constants.
 typedef struct color{
     Uint8 r;
     Uint8 g;
     Uint8 b;
+    Uint8 a;
 } color;
 
+#define COLOR_HEXA(h) ((color){ (Uint8)((Uint32)(h) >> 24), (Uint8)((Uint32)(h) >> 16), (Uint8)((Uint32)(h) >> 8), (Uint8)(h) })
+#define COLOR_HEX(h) COLOR_HEXA(((Uint32)(h) << 8) | 0xFF)
+
 color rgb(int r, int g, int b);
-color hex(char* h);
+color rgba(int r, int g, int b, int a);
+color hex(const char* h);
+
+// The blend mode lasts for the rest of the frame, then goes back to BLEND_ALPHA.
+typedef enum blendMode {
+    BLEND_ALPHA,
+    BLEND_ADD,
+    BLEND_MULTIPLY,
+    BLEND_NONE
+} blendMode;
+
+void setBlendMode(blendMode mode);
+blendMode getBlendMode(void);
 
 typedef void (*stateFunction)(void*);
 
@@ -37,9 +65,97 @@ typedef struct nest {
 
 int initNest(nest* n, const char* title, int width, int height);
 void setBackgroundColor(color c);
+void setHeadless(bool headless);
+void setDirtyRectMode(bool enabled);
+
+// Pipelined mode updates on its own thread; only the main thread may call SDL_Render*/SDL_*Texture.
+// textureLoad hands creation over to it; textureUnbind and layerDestroy release after the frame is presented.
+void setPipelinedMode(bool enabled);
+
+// Software rasterizer mode; call before initNest. It overrides dirty-rect mode.
+void setSoftwareRasterizer(bool enabled);
+
+// The late latch runs after the update with input sampled again; sequential mode only.
+void setLateLatch(void (*latch)(void));
 void runNest(void);
 void cleanNest(void);
 
+typedef struct replayStats {
+    Uint32 frames;
+    double seconds;
+} replayStats;
+
+bool replayRecord(const char* path);
+bool replayPlay(const char* path);
+void replayStop(void);
+bool replayIsPlaying(void);
+replayStats replayGetStats(void);
+
+// A custom allocator has to be installed before the engine allocates anything.
+typedef enum memoryCategory {
+    MEMORY_GENERAL,
+    MEMORY_RENDER,
+    MEMORY_GEOMETRY,
+    MEMORY_TEXTURES,
+    MEMORY_TEXT,
+    MEMORY_ANIMATION,
+    MEMORY_AUDIO,
+    MEMORY_ASSETS,
+    MEMORY_GAME,
+    MEMORY_CATEGORIES
+} memoryCategory;
+
+typedef struct allocator {
+    void* (*alloc)(size_t size, void* user);
+    void* (*resize)(void* p, size_t size, void* user);
+    void (*release)(void* p, void* user);
+    void* user;
+} allocator;
+
+typedef struct memoryStats {
+    size_t bytes[MEMORY_CATEGORIES];
+    size_t allocations[MEMORY_CATEGORIES];
+    size_t peakBytes;
+    int textures;
+    size_t textureBytes;
+    int surfaces;
+    size_t surfaceBytes;
+    size_t surfacePeakBytes;
+    size_t frameAllocations;
+} memoryStats;
+
+bool setAllocator(const allocator* a);
+void* memoryAlloc(memoryCategory category, size_t size);
+void* memoryCalloc(memoryCategory category, size_t count, size_t size);
+void* memoryRealloc(memoryCategory category, void* p, size_t size);
+void memoryFree(void* p);
+memoryStats memoryGetStats(void);
+void setStatsOverlay(bool enabled);
+
+// frameAlloc lasts until the next frame, frameAllocDouble one more; for the update, one thread at a time.
+typedef struct frameMark {
+    void* block;
+    size_t offset;
+    size_t used;
+} frameMark;
+
+typedef struct frameArenaStats {
+    size_t used;
+    size_t peak;
+    size_t capacity;
+    size_t doubleUsed;
+    size_t doublePeak;
+    size_t doubleCapacity;
+} frameArenaStats;
+
+void* frameAlloc(size_t size);
+void* frameAllocAligned(size_t size, size_t align);
+void* frameAllocDouble(size_t size);
+char* frameString(const char* format, ...);
+frameMark frameArenaMark(void);
+void frameArenaRewind(frameMark m);
+frameArenaStats frameArenaGetStats(void);
+
 typedef struct vector2 {
     float x;
     float y;
@@ -73,6 +189,78 @@ void angleToVectorRad(vector2* v, angle rad);
 float angleLerp(angle a, angle b, float t);
 float angleLerpRad(angle a, angle b, float t);
 
+float lerpf(float a, float b, float t);
+void vectorLerp(vector2* result, vector2* a, vector2* b, float t);
+
+typedef enum easing {
+    EASE_LINEAR,
+    EASE_IN_QUAD,
+    EASE_OUT_QUAD,
+    EASE_IN_OUT_QUAD,
+    EASE_IN_CUBIC,
+    EASE_OUT_CUBIC,
+    EASE_IN_OUT_CUBIC,
+    EASE_IN_SINE,
+    EASE_OUT_SINE,
+    EASE_IN_OUT_SINE,
+    EASE_IN_EXPO,
+    EASE_OUT_EXPO,
+    EASE_IN_BACK,
+    EASE_OUT_BACK,
+    EASE_IN_ELASTIC,
+    EASE_OUT_ELASTIC,
+    EASE_IN_BOUNCE,
+    EASE_OUT_BOUNCE,
+    EASING_COUNT
+} easing;
+
+float ease(easing e, float t);
+
+// A tween's target must outlive it or be cancelled with tweenCancelTarget.
+typedef Uint32 tween;
+
+tween tweenFloat(float* target, float to, float duration, easing e);
+tween tweenVector(vector2* target, vector2 to, float duration, easing e);
+tween tweenAngle(angle target, float to, float duration, easing e);
+tween tweenColor(color* target, color to, float duration, easing e);
+void tweenDelay(tween t, float delay);
+void tweenCancel(tween t);
+void tweenCancelTarget(void* target);
+bool tweenActive(tween t);
+
+// Input reflects the events polled before each update, or the replay's while one plays.
+typedef enum inputDevice {
+    INPUT_KEYBOARD = 1,
+    INPUT_MOUSE = 2,
+    INPUT_CONTROLLER = 4,
+    INPUT_TEXT = 8
+} inputDevice;
+
+void setInputDevices(Uint32 devices);
+bool keyHeld(SDL_Scancode key);
+bool keyPressed(SDL_Scancode key);
+bool keyReleased(SDL_Scancode key);
+bool mouseHeld(int button);
+bool mousePressed(int button);
+bool mouseReleased(int button);
+vector2 mousePosition(void);
+vector2 mouseWheel(void);
+bool padConnected(int pad);
+bool padHeld(int pad, SDL_GameControllerButton button);
+bool padPressed(int pad, SDL_GameControllerButton button);
+bool padReleased(int pad, SDL_GameControllerButton button);
+float padAxis(int pad, SDL_GameControllerAxis axis);
+
+// Actions are named sets of up to eight bindings; a pad of -1 matches any pad.
+int inputAction(const char* name);
+bool inputBindKey(int action, SDL_Scancode key);
+bool inputBindMouse(int action, int button);
+bool inputBindPad(int action, int pad, SDL_GameControllerButton button);
+void inputUnbind(int action);
+bool actionHeld(int action);
+bool actionPressed(int action);
+bool actionReleased(int action);
+
 typedef struct entity {
     int id;
     SDL_Texture* tex;
@@ -87,15 +275,28 @@ typedef enum {
     LINE
 } shapeType;
 
+typedef enum {
+    JOIN_MITER,
+    JOIN_BEVEL,
+    JOIN_ROUND
+} lineJoin;
+
+typedef enum {
+    CAP_BUTT,
+    CAP_SQUARE,
+    CAP_ROUND
+} lineCap;
+
 typedef struct primitive {
     entity base;
     shapeType type;
     color color;
+    bool filled;
     union {
         struct { float width; float height; } rectangle;
         struct { float radius; int segments; } circle;
         struct { float base; float height; float skew; } triangle;
-        struct { vector2 endPoint; float width; } line;
+        struct { vector2 endPoint; float width; lineCap cap; } line;
     };
 } primitive;
 
@@ -104,11 +305,156 @@ primitive newCircle(vector2 position, float radius, int segments, color color);
 primitive newTriangle(vector2 position, float base, float height, float skew, color color);
 primitive newLine(vector2 pointA, vector2 pointB, float width, color color);
 void drawPrimitive(primitive* p);
+void drawPolyline(vector2* points, int count, float width, lineJoin join, lineCap cap, color color);
+
+// Mounted packs are searched newest first, then the filesystem; packFind data lives until unmount.
+typedef struct pack pack;
+
+pack* packMount(const char* path);
+void packUnmount(pack* p);
+const void* packFind(const char* name, size_t* size);
 
 typedef SDL_Texture (*texture);
 
+typedef enum textureFilter {
+    FILTER_BOX,
+    FILTER_BILINEAR
+} textureFilter;
+
+// Images are downscaled before upload to fit these limits; zero disables a limit.
+typedef struct textureScaling {
+    int referenceWidth;
+    int referenceHeight;
+    int maxDimension;
+    textureFilter filter;
+} textureScaling;
+
+void setTextureScaling(const textureScaling* scaling);
 texture textureLoad(char const *path);
+texture textureLoadEx(char const *path, const textureScaling* scaling);
 bool textureBind(entity* e, texture t);
 void textureUnbind(entity* e);
+void textureFree(texture t);
+
+typedef struct sprite {
+    texture tex;
+    SDL_Rect source;
+    vector2 position;
+    float width;
+    float height;
+    float rotation;
+    SDL_RendererFlip flip;
+    color tint;
+    Uint8 layer;
+    float depth;
+} sprite;
+
+sprite newSprite(texture t, vector2 position);
+void drawSprite(sprite* s);
+void spriteFlush(void);
+
+// Animations advance once per frame before the update; stale handles are ignored.
+typedef struct animationClip animationClip;
+typedef Uint32 animation;
+
+typedef enum animationLoop {
+    LOOP_NONE,
+    LOOP_REPEAT,
+    LOOP_PINGPONG
+} animationLoop;
+
+animationClip* animationClipCreate(texture sheet, const SDL_Rect* frames, int count, float fps);
+animationClip* animationClipGrid(texture sheet, int frameWidth, int frameHeight, int first, int count, float fps);
+void animationClipDestroy(animationClip* c);
+animation animationPlay(animationClip* c, animationLoop loop, float speed);
+void animationStop(animation a);
+void animationRestart(animation a);
+void animationSetSpeed(animation a, float speed);
+bool animationFinished(animation a);
+SDL_Rect animationFrame(animation a);
+void animationApply(animation a, sprite* s);
+
+typedef struct layer layer;
+
+layer* layerCreate(const char* name, bool isStatic);
+layer* layerGet(const char* name);
+void layerDestroy(layer* l);
+void layerSetStatic(layer* l, bool isStatic);
+bool layerAddPrimitive(layer* l, primitive* p);
+bool layerAddEntity(layer* l, entity* e);
+void layerRemove(layer* l, entity* e);
+void layerClear(layer* l);
+void layerDirty(layer* l);
+void drawLayer(layer* l);
+
+typedef struct tilemap tilemap;
+
+tilemap* tilemapCreate(texture tileset, int tileWidth, int tileHeight, int columns, int rows);
+void tilemapDestroy(tilemap* m);
+void tilemapSetTile(tilemap* m, int x, int y, int tile);
+int tilemapGetTile(tilemap* m, int x, int y);
+void drawTilemap(tilemap* m, vector2 offset);
+
+// Text is batched per font page and drawn on top of everything else when the frame is presented.
+typedef struct font font;
+
+font* fontLoad(const char* path);
+font* fontDefault(void);
+void fontDestroy(font* f);
+void drawText(font* f, const char* text, vector2 position, float scale, color color);
+vector2 textMeasure(font* f, const char* text, float scale);
+
+// Sound calls only queue commands for the audio thread; pan runs from -1 to 1.
+typedef struct sound sound;
+typedef Uint32 voice;
+
+bool audioOpen(void);
+sound* soundLoad(const char* path);
+void soundDestroy(sound* s);
+voice soundPlay(sound* s, float volume, float pan, bool loop);
+void voiceStop(voice v);
+void voiceSetVolume(voice v, float volume, float pan);
+void setMasterVolume(float volume);
+
+// Music streams from disk; playing an ended track restarts it.
+typedef struct music music;
+
+music* musicOpen(const char* path);
+void musicClose(music* m);
+voice musicPlay(music* m, float volume, bool loop);
+bool musicFinished(music* m);
+
+// Path cell costs: 0 blocks, higher is slower; pathFind returns the full path length or -1.
+typedef struct pathGrid pathGrid;
+typedef struct pathField pathField;
+
+typedef struct pathRequest {
+    SDL_Point start;
+    SDL_Point goal;
+    SDL_Point* points;
+    int capacity;
+    int count;
+} pathRequest;
+
+pathGrid* pathGridCreate(int columns, int rows);
+void pathGridDestroy(pathGrid* g);
+void pathSetCost(pathGrid* g, int x, int y, int cost);
+int pathGetCost(const pathGrid* g, int x, int y);
+int pathFind(pathGrid* g, SDL_Point start, SDL_Point goal, SDL_Point* points, int capacity);
+void pathFindMany(pathGrid* g, pathRequest* requests, int count);
+pathField* pathFieldCreate(pathGrid* g);
+void pathFieldDestroy(pathField* f);
+bool pathFieldBuild(pathField* f, SDL_Point goal);
+float pathFieldDistance(const pathField* f, int x, int y);
+vector2 pathFieldDirection(const pathField* f, int x, int y);
+
+// Post effects run in order on the CPU; adds return an index or -1. A LUT holds size^3 colors, red fastest.
+int postAddBlur(float radius);
+int postAddBloom(float threshold, float intensity, float radius);
+int postAddLUT(const color* lut, int size);
+int postAddVignette(float strength, float radius);
+void postClear(void);
+void setPostScale(int divisor);
+double postEffectTime(int index);
 
 #endif
\ No newline at end of file
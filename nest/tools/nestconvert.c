@@ -0,0 +1,207 @@
+#define SDL_MAIN_HANDLED
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RAW_VERSION 1
+#define RAW_HEADER 32
+
+static void writeU32LE(unsigned char* out, Uint32 value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+static void writeU32BE(unsigned char* out, Uint32 value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(value >> (24 - i * 8));
+    }
+}
+
+static size_t encodeQOI(const SDL_Surface* s, int channels, unsigned char* out) {
+    unsigned char index[64][4];
+    unsigned char previous[4] = { 0, 0, 0, 255 };
+    size_t at = 0;
+    int run = 0;
+    int total = s->w * s->h;
+
+    memset(index, 0, sizeof(index));
+    memcpy(out, "qoif", 4);
+    writeU32BE(out + 4, (Uint32)s->w);
+    writeU32BE(out + 8, (Uint32)s->h);
+    out[12] = (unsigned char)channels;
+    out[13] = 0;
+    at = 14;
+
+    for (int i = 0; i < total; i++) {
+        const unsigned char* px = (const unsigned char*)s->pixels + (i / s->w) * s->pitch + (i % s->w) * 4;
+
+        if (memcmp(px, previous, 4) == 0) {
+            run++;
+
+            if (run == 62 || i == total - 1) {
+                out[at++] = (unsigned char)(0xC0 | (run - 1));
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run > 0) {
+            out[at++] = (unsigned char)(0xC0 | (run - 1));
+            run = 0;
+        }
+
+        int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63;
+
+        if (memcmp(index[hash], px, 4) == 0) {
+            out[at++] = (unsigned char)hash;
+        }
+        else {
+            memcpy(index[hash], px, 4);
+
+            if (px[3] == previous[3]) {
+                signed char dr = (signed char)(px[0] - previous[0]);
+                signed char dg = (signed char)(px[1] - previous[1]);
+                signed char db = (signed char)(px[2] - previous[2]);
+                int drg = dr - dg;
+                int dbg = db - dg;
+
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    out[at++] = (unsigned char)(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                }
+                else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                    out[at++] = (unsigned char)(0x80 | (dg + 32));
+                    out[at++] = (unsigned char)(((drg + 8) << 4) | (dbg + 8));
+                }
+                else {
+                    out[at++] = 0xFE;
+                    memcpy(out + at, px, 3);
+                    at += 3;
+                }
+            }
+            else {
+                out[at++] = 0xFF;
+                memcpy(out + at, px, 4);
+                at += 4;
+            }
+        }
+
+        memcpy(previous, px, 4);
+    }
+
+    memset(out + at, 0, 7);
+    out[at + 7] = 1;
+
+    return at + 8;
+}
+
+static Uint32 rawFormat(const char* name) {
+    if (!name || strcmp(name, "argb") == 0) {
+        return SDL_PIXELFORMAT_ARGB8888;
+    }
+
+    if (strcmp(name, "abgr") == 0) {
+        return SDL_PIXELFORMAT_ABGR8888;
+    }
+
+    if (strcmp(name, "rgba") == 0) {
+        return SDL_PIXELFORMAT_RGBA8888;
+    }
+
+    if (strcmp(name, "bgra") == 0) {
+        return SDL_PIXELFORMAT_BGRA8888;
+    }
+
+    return SDL_PIXELFORMAT_UNKNOWN;
+}
+
+static int hasSuffix(const char* path, const char* suffix) {
+    size_t length = strlen(path);
+    size_t suffixLength = strlen(suffix);
+
+    return length >= suffixLength && SDL_strcasecmp(path + length - suffixLength, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (!hasSuffix(argv[2], ".qoi") && !hasSuffix(argv[2], ".nraw"))) {
+        fprintf(stderr, "usage: nestconvert <input image> <output.qoi>\n");
+        fprintf(stderr, "       nestconvert <input image> <output.nraw> [argb|abgr|rgba|bgra]\n");
+        fprintf(stderr, ".nraw stores pixels in the renderer's texture format, argb by default\n");
+        return 1;
+    }
+
+    int qoi = hasSuffix(argv[2], ".qoi");
+    Uint32 format = qoi ? SDL_PIXELFORMAT_RGBA32 : rawFormat(argc > 3 ? argv[3] : NULL);
+
+    if (format == SDL_PIXELFORMAT_UNKNOWN) {
+        fprintf(stderr, "nestconvert: unknown pixel format %s\n", argv[3]);
+        return 1;
+    }
+
+    SDL_Surface* loaded = IMG_Load(argv[1]);
+
+    if (!loaded) {
+        fprintf(stderr, "nestconvert: %s\n", IMG_GetError());
+        return 1;
+    }
+
+    int channels = SDL_ISPIXELFORMAT_ALPHA(loaded->format->format) || loaded->format->palette ? 4 : 3;
+    SDL_Surface* s = SDL_ConvertSurfaceFormat(loaded, format, 0);
+    SDL_FreeSurface(loaded);
+
+    if (!s) {
+        fprintf(stderr, "nestconvert: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    size_t capacity = qoi ? 14 + (size_t)s->w * s->h * 5 + 8 : RAW_HEADER + (size_t)s->w * s->h * 4;
+    unsigned char* out = malloc(capacity);
+    size_t size = 0;
+
+    if (!out) {
+        SDL_FreeSurface(s);
+        return 1;
+    }
+
+    if (qoi) {
+        size = encodeQOI(s, channels, out);
+    }
+    else {
+        memset(out, 0, RAW_HEADER);
+        memcpy(out, "NRAW", 4);
+        writeU32LE(out + 4, RAW_VERSION);
+        writeU32LE(out + 8, (Uint32)s->w);
+        writeU32LE(out + 12, (Uint32)s->h);
+        writeU32LE(out + 16, format);
+        writeU32LE(out + 20, (Uint32)s->w * 4);
+
+        for (int y = 0; y < s->h; y++) {
+            memcpy(out + RAW_HEADER + (size_t)y * s->w * 4, (Uint8*)s->pixels + y * s->pitch, (size_t)s->w * 4);
+        }
+
+        size = capacity;
+    }
+
+    FILE* file = fopen(argv[2], "wb");
+    int failed = !file || fwrite(out, 1, size, file) != size;
+
+    if (file && fclose(file) != 0) {
+        failed = 1;
+    }
+
+    if (failed) {
+        fprintf(stderr, "nestconvert: cannot write %s\n", argv[2]);
+    }
+    else {
+        printf("%s: %dx%d, %zu bytes\n", argv[2], s->w, s->h, size);
+    }
+
+    free(out);
+    SDL_FreeSurface(s);
+
+    return failed;
+}
@@ -0,0 +1,253 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PACK_MAGIC 0x4B41504E
+#define PACK_VERSION 2
+#define PACK_ALIGN 16
+#define PACK_HEADER 16
+#define PACK_ENTRY 32
+
+#ifdef _WIN32
+#define fileSeek _fseeki64
+#define fileTell _ftelli64
+#else
+#define fileSeek fseeko
+#define fileTell ftello
+#endif
+
+typedef struct packFile {
+    const char* path;
+    const char* name;
+    uint32_t nameOffset;
+    uint32_t nameSize;
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+} packFile;
+
+static const char* packName(const char* path) {
+    while (path[0] == '.' && (path[1] == '/' || path[1] == '\\')) {
+        path += 2;
+    }
+
+    return path;
+}
+
+static uint64_t packHash(const char* name) {
+    uint64_t hash = 14695981039346656037ull;
+
+    while (name[0] == '.' && (name[1] == '/' || name[1] == '\\')) {
+        name += 2;
+    }
+
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)(*name == '\\' ? '/' : *name)) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static int packCompare(const void* a, const void* b) {
+    uint64_t x = ((const packFile*)a)->hash;
+    uint64_t y = ((const packFile*)b)->hash;
+    return (x > y) - (x < y);
+}
+
+static void writeU32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+static void writeU64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+static int64_t fileSize(const char* path) {
+    FILE* file = fopen(path, "rb");
+    int64_t size = -1;
+
+    if (file) {
+        if (fileSeek(file, 0, SEEK_END) == 0) {
+            size = (int64_t)fileTell(file);
+        }
+
+        fclose(file);
+    }
+
+    return size;
+}
+
+static int writeZero(FILE* out, uint64_t size) {
+    static const unsigned char zero[PACK_ALIGN];
+
+    return size <= sizeof(zero) && fwrite(zero, 1, (size_t)size, out) == size ? 0 : -1;
+}
+
+static int writeName(FILE* out, const char* name) {
+    size_t size = strlen(name);
+
+    for (size_t i = 0; i < size; i++) {
+        if (fputc(name[i] == '\\' ? '/' : name[i], out) == EOF) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int copyFile(FILE* out, const char* path, uint64_t size) {
+    FILE* file = fopen(path, "rb");
+    char buffer[65536];
+
+    if (!file) {
+        return -1;
+    }
+
+    while (size > 0) {
+        size_t chunk = size < sizeof(buffer) ? (size_t)size : sizeof(buffer);
+
+        if (fread(buffer, 1, chunk, file) != chunk || fwrite(buffer, 1, chunk, out) != chunk) {
+            fclose(file);
+            return -1;
+        }
+
+        size -= chunk;
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+static int fail(packFile* files, FILE* out, const char* message, const char* path) {
+    fprintf(stderr, "nestpack: %s %s\n", message, path);
+    free(files);
+
+    if (out) {
+        fclose(out);
+    }
+
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: nestpack <output.pack> <file>...\n");
+        fprintf(stderr, "files are stored under the path given, which is the name passed to textureLoad\n");
+        return 1;
+    }
+
+    int count = argc - 2;
+    packFile* files = calloc(count, sizeof(packFile));
+    uint64_t names = 0;
+
+    if (!files) {
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int64_t size = fileSize(argv[i + 2]);
+
+        if (size < 0) {
+            return fail(files, NULL, "cannot read", argv[i + 2]);
+        }
+
+        files[i].path = argv[i + 2];
+        files[i].name = packName(argv[i + 2]);
+        files[i].hash = packHash(argv[i + 2]);
+        files[i].size = (uint64_t)size;
+    }
+
+    qsort(files, count, sizeof(packFile), packCompare);
+
+    uint64_t offset = PACK_HEADER + (uint64_t)count * PACK_ENTRY;
+
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && files[i].hash == files[i - 1].hash) {
+            fprintf(stderr, "nestpack: %s and %s have the same name hash\n", files[i - 1].path, files[i].path);
+            free(files);
+            return 1;
+        }
+
+        files[i].nameOffset = (uint32_t)(offset + names);
+        files[i].nameSize = (uint32_t)strlen(files[i].name);
+        names += files[i].nameSize;
+
+        if (offset + names > UINT32_MAX) {
+            return fail(files, NULL, "too many names for", argv[1]);
+        }
+    }
+
+    offset += names;
+
+    for (int i = 0; i < count; i++) {
+        offset = (offset + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1);
+        files[i].offset = offset;
+        offset += files[i].size;
+    }
+
+    FILE* out = fopen(argv[1], "wb");
+    unsigned char header[PACK_HEADER];
+    uint64_t position = PACK_HEADER + (uint64_t)count * PACK_ENTRY + names;
+
+    if (!out) {
+        return fail(files, NULL, "cannot create", argv[1]);
+    }
+
+    writeU32(header, PACK_MAGIC);
+    writeU32(header + 4, PACK_VERSION);
+    writeU32(header + 8, (uint32_t)count);
+    writeU32(header + 12, 0);
+
+    if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+        return fail(files, out, "cannot write", argv[1]);
+    }
+
+    for (int i = 0; i < count; i++) {
+        unsigned char entry[PACK_ENTRY];
+
+        writeU64(entry, files[i].hash);
+        writeU64(entry + 8, files[i].offset);
+        writeU64(entry + 16, files[i].size);
+        writeU32(entry + 24, files[i].nameOffset);
+        writeU32(entry + 28, files[i].nameSize);
+
+        if (fwrite(entry, 1, sizeof(entry), out) != sizeof(entry)) {
+            return fail(files, out, "cannot write", argv[1]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (writeName(out, files[i].name) != 0) {
+            return fail(files, out, "cannot write", argv[1]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (writeZero(out, files[i].offset - position) != 0) {
+            return fail(files, out, "cannot write", argv[1]);
+        }
+
+        if (copyFile(out, files[i].path, files[i].size) != 0) {
+            return fail(files, out, "cannot read", files[i].path);
+        }
+
+        position = files[i].offset + files[i].size;
+    }
+
+    if (fclose(out) != 0) {
+        return fail(files, NULL, "cannot write", argv[1]);
+    }
+
+    printf("packed %d files into %s (%llu bytes)\n", count, argv[1], (unsigned long long)offset);
+    free(files);
+
+    return 0;
+}
@@ -43,7 +43,7 @@ int main() {
         return -1;
     }
 
-    setBackgroundColor(hex("#1e3f45"));
+    setBackgroundColor(COLOR_HEX(0x1e3f45));
     
     setCurrentState(&testA, &testB, &testC);
 